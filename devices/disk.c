@@ -84,7 +84,7 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -216,7 +216,7 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
 
 	c = d->channel;
 	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
+	select_sector (d, sec_no, 1);
 	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
 	sema_down (&c->completion_wait);
 	if (!wait_while_busy (d))
@@ -240,7 +240,7 @@ disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
 
 	c = d->channel;
 	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
+	select_sector (d, sec_no, 1);
 	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
 	if (!wait_while_busy (d))
 		PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
@@ -250,6 +250,85 @@ disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
 	lock_release (&c->lock);
 }
 
+/* Reads the CNT sectors starting at SEC_NO from disk D, sector I
+   into BUFFERS[I], each of which must have room for
+   DISK_SECTOR_SIZE bytes.  Up to DISK_MAX_SECTORS sectors are
+   transferred by a single command, which is much faster than
+   reading them one by one.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_read_sectors (struct disk *d, disk_sector_t sec_no,
+		void *const buffers[], size_t cnt) {
+	struct channel *c;
+
+	ASSERT (d != NULL);
+	ASSERT (buffers != NULL);
+
+	c = d->channel;
+	lock_acquire (&c->lock);
+	while (cnt > 0) {
+		size_t chunk = cnt < DISK_MAX_SECTORS ? cnt : DISK_MAX_SECTORS;
+		size_t i;
+
+		/* The disk interrupts once for each sector it has ready. */
+		select_sector (d, sec_no, chunk);
+		issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+		for (i = 0; i < chunk; i++) {
+			sema_down (&c->completion_wait);
+			if (!wait_while_busy (d))
+				PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name,
+						(disk_sector_t) (sec_no + i));
+			input_sector (c, buffers[i]);
+		}
+		d->read_cnt += chunk;
+		sec_no += chunk;
+		buffers += chunk;
+		cnt -= chunk;
+	}
+	lock_release (&c->lock);
+}
+
+/* Writes the CNT sectors starting at SEC_NO to disk D, sector I
+   from BUFFERS[I], each of which must contain DISK_SECTOR_SIZE
+   bytes.  Like disk_read_sectors(), transfers up to
+   DISK_MAX_SECTORS sectors per command.  Returns after the disk
+   has acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write_sectors (struct disk *d, disk_sector_t sec_no,
+		const void *const buffers[], size_t cnt) {
+	struct channel *c;
+
+	ASSERT (d != NULL);
+	ASSERT (buffers != NULL);
+
+	c = d->channel;
+	lock_acquire (&c->lock);
+	while (cnt > 0) {
+		size_t chunk = cnt < DISK_MAX_SECTORS ? cnt : DISK_MAX_SECTORS;
+		size_t i;
+
+		/* The disk asks for each sector in turn and interrupts once
+		   it has taken it. */
+		select_sector (d, sec_no, chunk);
+		issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+		for (i = 0; i < chunk; i++) {
+			if (!wait_while_busy (d))
+				PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name,
+						(disk_sector_t) (sec_no + i));
+			output_sector (c, buffers[i]);
+			sema_down (&c->completion_wait);
+		}
+		d->write_cnt += chunk;
+		sec_no += chunk;
+		buffers += chunk;
+		cnt -= chunk;
+	}
+	lock_release (&c->lock);
+}
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
@@ -402,17 +481,19 @@ print_ata_string (char *string, size_t size) {
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT to the disk's sector selection
+   registers, to access CNT sectors starting at SEC_NO.  (We use
+   LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) {
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
-	ASSERT (sec_no < d->capacity);
+	ASSERT (cnt >= 1 && cnt <= DISK_MAX_SECTORS);
+	ASSERT (sec_no + cnt <= d->capacity);
 	ASSERT (sec_no < (1UL << 28));
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt == DISK_MAX_SECTORS ? 0 : cnt);
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
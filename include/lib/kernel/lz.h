@@ -0,0 +1,37 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+/* LZ77 compression in the style of LZ4.
+ *
+ * Fast enough to run on every page that is swapped out: the
+ * compressor finds matches through a single hash table of recent
+ * positions, without chains, and the decompressor does nothing but
+ * copy literals and earlier output.  Buffers may be up to
+ * LZ_MAX_LEN bytes.
+ *
+ * The compressed form is a sequence of runs.  Each run is a token
+ * byte, whose high and low nibbles hold a literal length and a
+ * match length less LZ_MIN_MATCH, followed by the literals and a
+ * 16-bit little-endian match offset.  A nibble of 15 is continued
+ * in following bytes, each added in until one is less than 255.
+ * The last run has literals only. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Shortest match worth encoding. */
+#define LZ_MIN_MATCH 4
+
+/* Longest buffer that can be compressed. */
+#define LZ_MAX_LEN 65535
+
+/* Bytes of scratch memory lz_compress() needs. */
+#define LZ_WORK_SIZE (1024 * sizeof (uint16_t))
+
+size_t lz_compress (const void *src, size_t src_len, void *dst,
+		size_t dst_cap, void *work);
+bool lz_decompress (const void *src, size_t src_len, void *dst,
+		size_t dst_len);
+
+#endif /* lib/kernel/lz.h */
@@ -0,0 +1,110 @@
+#ifndef __LIB_KERNEL_OHASH_H
+#define __LIB_KERNEL_OHASH_H
+
+/* Open-addressing hash table.
+ *
+ * A drop-in alternative to the chained table in hash.h, with the
+ * same embedding style and the same set of operations.  Instead
+ * of an array of lists, the table is a single array of slots, each
+ * holding an element's hash value next to a pointer to the
+ * element.  Lookups probe consecutive slots (linear probing) and
+ * compare the stored hash values before calling the comparison
+ * function, so a search touches one or two cache lines instead of
+ * chasing list pointers.
+ *
+ * Growing or shrinking the table does not move every element at
+ * once.  A new array is allocated and the old one is drained a few
+ * slots at a time by each later insertion or deletion; searches
+ * look in both arrays until the old one is empty.
+ *
+ * Each structure that can be in an ohash embeds a struct
+ * ohash_elem member, and ohash_entry converts a pointer to that
+ * member back to the outer structure, just like hash_entry. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Hash element. */
+struct ohash_elem {
+	uint64_t hash;              /* Hash value, cached by the table. */
+};
+
+/* Converts pointer to hash element OHASH_ELEM into a pointer to
+ * the structure that OHASH_ELEM is embedded inside.  Supply the
+ * name of the outer structure STRUCT and the member name MEMBER
+ * of the hash element. */
+#define ohash_entry(OHASH_ELEM, STRUCT, MEMBER)                 \
+	((STRUCT *) ((uint8_t *) &(OHASH_ELEM)->hash            \
+		- offsetof (STRUCT, MEMBER.hash)))
+
+/* Computes and returns the hash value for hash element E, given
+ * auxiliary data AUX. */
+typedef uint64_t ohash_hash_func (const struct ohash_elem *e, void *aux);
+
+/* Compares the value of two hash elements A and B, given
+ * auxiliary data AUX.  Returns true if A is less than B, or
+ * false if A is greater than or equal to B. */
+typedef bool ohash_less_func (const struct ohash_elem *a,
+		const struct ohash_elem *b,
+		void *aux);
+
+/* Performs some operation on hash element E, given auxiliary
+ * data AUX. */
+typedef void ohash_action_func (struct ohash_elem *e, void *aux);
+
+/* A slot in the table's array. */
+struct ohash_slot {
+	uint64_t hash;              /* Hash value of ELEM. */
+	struct ohash_elem *elem;    /* Element, or a null pointer if empty. */
+};
+
+/* Hash table. */
+struct ohash {
+	size_t elem_cnt;            /* Number of elements in table. */
+	size_t slot_cnt;            /* Number of slots, a power of 2. */
+	struct ohash_slot *slots;   /* Array of `slot_cnt' slots. */
+	size_t old_slot_cnt;        /* Slots in array being drained, or 0. */
+	struct ohash_slot *old_slots; /* Array being drained, or null. */
+	size_t old_idx;             /* Slots below this have been drained. */
+	ohash_hash_func *hash;      /* Hash function. */
+	ohash_less_func *less;      /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `hash' and `less'. */
+};
+
+/* A hash table iterator. */
+struct ohash_iterator {
+	struct ohash *hash;         /* The hash table. */
+	size_t pos;                 /* Old slots first, then new ones. */
+	struct ohash_elem *elem;    /* Current hash element. */
+};
+
+/* Basic life cycle. */
+bool ohash_init (struct ohash *, ohash_hash_func *, ohash_less_func *,
+		void *aux);
+void ohash_clear (struct ohash *, ohash_action_func *);
+void ohash_destroy (struct ohash *, ohash_action_func *);
+
+/* Search, insertion, deletion. */
+struct ohash_elem *ohash_insert (struct ohash *, struct ohash_elem *);
+struct ohash_elem *ohash_replace (struct ohash *, struct ohash_elem *);
+struct ohash_elem *ohash_find (struct ohash *, struct ohash_elem *);
+struct ohash_elem *ohash_delete (struct ohash *, struct ohash_elem *);
+
+/* Iteration. */
+void ohash_apply (struct ohash *, ohash_action_func *);
+void ohash_first (struct ohash_iterator *, struct ohash *);
+struct ohash_elem *ohash_next (struct ohash_iterator *);
+struct ohash_elem *ohash_cur (struct ohash_iterator *);
+
+/* Information. */
+size_t ohash_size (struct ohash *);
+bool ohash_empty (struct ohash *);
+
+/* Sample hash functions. */
+uint64_t ohash_bytes (const void *, size_t);
+uint64_t ohash_string (const char *);
+uint64_t ohash_int (int);
+uint64_t ohash_u64 (uint64_t);
+
+#endif /* lib/kernel/ohash.h */
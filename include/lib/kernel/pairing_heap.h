@@ -0,0 +1,77 @@
+#ifndef __LIB_KERNEL_PAIRING_HEAP_H
+#define __LIB_KERNEL_PAIRING_HEAP_H
+
+/* Pairing heap.
+ *
+ * A priority queue with O(1) insertion and O(log n) amortized
+ * removal of the top element, for the many places that now keep
+ * a list sorted with list_insert_ordered() only to take its
+ * front.  As with lists, each structure that can be in a heap
+ * embeds a struct pairing_heap_elem member, and
+ * pairing_heap_entry converts a pointer to that member back to
+ * the outer structure.
+ *
+ * The top of the heap is an element that no other element is
+ * less than, according to the heap's less function.  Unlike
+ * list_insert_ordered(), the heap does not keep equal elements
+ * in insertion order; a caller that needs FIFO order among equals
+ * has to fold a sequence number into its comparison. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct pairing_heap_elem {
+	struct pairing_heap_elem *child;  /* First child, or null. */
+	struct pairing_heap_elem *next;   /* Next sibling, or null. */
+	struct pairing_heap_elem *prev;   /* Previous sibling, or parent
+	                                     for a first child, or null
+	                                     for the top. */
+};
+
+/* Converts pointer to heap element PAIRING_HEAP_ELEM into a
+   pointer to the structure that PAIRING_HEAP_ELEM is embedded
+   inside.  Supply the name of the outer structure STRUCT and the
+   member name MEMBER of the heap element. */
+#define pairing_heap_entry(PAIRING_HEAP_ELEM, STRUCT, MEMBER)   \
+	((STRUCT *) ((uint8_t *) &(PAIRING_HEAP_ELEM)->child    \
+		- offsetof (STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, that is,
+   if A belongs closer to the top, or false if A is greater than
+   or equal to B. */
+typedef bool pairing_heap_less_func (const struct pairing_heap_elem *a,
+		const struct pairing_heap_elem *b,
+		void *aux);
+
+/* Pairing heap. */
+struct pairing_heap {
+	struct pairing_heap_elem *top;  /* Top element, or null if empty. */
+	size_t elem_cnt;                /* Number of elements. */
+	pairing_heap_less_func *less;   /* Comparison function. */
+	void *aux;                      /* Auxiliary data for `less'. */
+};
+
+void pairing_heap_init (struct pairing_heap *, pairing_heap_less_func *,
+		void *aux);
+
+/* Insertion and removal. */
+void pairing_heap_push (struct pairing_heap *, struct pairing_heap_elem *);
+struct pairing_heap_elem *pairing_heap_pop (struct pairing_heap *);
+void pairing_heap_remove (struct pairing_heap *,
+		struct pairing_heap_elem *);
+
+/* Changing an element's key. */
+void pairing_heap_decrease (struct pairing_heap *,
+		struct pairing_heap_elem *);
+void pairing_heap_update (struct pairing_heap *,
+		struct pairing_heap_elem *);
+
+/* Properties. */
+struct pairing_heap_elem *pairing_heap_top (struct pairing_heap *);
+size_t pairing_heap_size (struct pairing_heap *);
+bool pairing_heap_empty (struct pairing_heap *);
+
+#endif /* lib/kernel/pairing_heap.h */
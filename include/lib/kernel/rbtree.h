@@ -0,0 +1,118 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+ *
+ * A balanced binary search tree with O(log n) insertion, removal,
+ * and search, and O(1) amortized in-order stepping.  Like lists
+ * and hash tables, the tree does no allocation of its own: each
+ * structure that can be in a tree embeds a struct rb_elem member,
+ * and rbtree_entry converts a pointer to that member back to the
+ * outer structure.
+ *
+ * Elements are ordered by a less function, as for list_sort() and
+ * list_insert_ordered().  Equal elements are allowed; a new
+ * element goes after any equal ones already in the tree, so
+ * rbtree_min() on a tree of equal keys returns them in insertion
+ * order, just as a list kept with list_insert_ordered() would.
+ *
+ * A tree may also be augmented: each element can keep a summary
+ * of its subtree (for example, the largest end point of the
+ * intervals in it) that the tree keeps up to date through an
+ * update function.  The interval tree at the bottom of this file
+ * is built this way. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree element. */
+struct rb_elem {
+	struct rb_elem *parent;     /* Parent, or null for the root. */
+	struct rb_elem *left;       /* Left child, or null. */
+	struct rb_elem *right;      /* Right child, or null. */
+	bool red;                   /* Node color. */
+};
+
+/* Converts pointer to tree element RB_ELEM into a pointer to the
+   structure that RB_ELEM is embedded inside.  Supply the name of
+   the outer structure STRUCT and the member name MEMBER of the
+   tree element. */
+#define rbtree_entry(RB_ELEM, STRUCT, MEMBER)           \
+	((STRUCT *) ((uint8_t *) &(RB_ELEM)->parent     \
+		- offsetof (STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_elem *a,
+		const struct rb_elem *b,
+		void *aux);
+
+/* Recomputes the augmented data of element E from E itself and
+   its children E->left and E->right, whose augmented data is
+   already up to date, given auxiliary data AUX. */
+typedef void rb_update_func (struct rb_elem *e, void *aux);
+
+/* Red-black tree. */
+struct rbtree {
+	struct rb_elem *root;       /* Root, or null if empty. */
+	size_t elem_cnt;            /* Number of elements. */
+	rb_less_func *less;         /* Comparison function. */
+	rb_update_func *update;     /* Augmentation, or null. */
+	void *aux;                  /* Auxiliary data for `less', `update'. */
+};
+
+void rbtree_init (struct rbtree *, rb_less_func *, rb_update_func *,
+		void *aux);
+
+/* Insertion and removal. */
+void rbtree_insert (struct rbtree *, struct rb_elem *);
+void rbtree_remove (struct rbtree *, struct rb_elem *);
+struct rb_elem *rbtree_pop_min (struct rbtree *);
+
+/* Search. */
+struct rb_elem *rbtree_find (struct rbtree *, const struct rb_elem *);
+struct rb_elem *rbtree_lower_bound (struct rbtree *,
+		const struct rb_elem *);
+
+/* Traversal. */
+struct rb_elem *rbtree_min (struct rbtree *);
+struct rb_elem *rbtree_max (struct rbtree *);
+struct rb_elem *rbtree_next (struct rb_elem *);
+struct rb_elem *rbtree_prev (struct rb_elem *);
+
+/* Properties. */
+size_t rbtree_size (struct rbtree *);
+bool rbtree_empty (struct rbtree *);
+
+/* Interval tree.
+ *
+ * An rbtree of half-open intervals [START, END), ordered by
+ * START, in which every element also records the largest END in
+ * its subtree.  That lets itree_first() and itree_next() find
+ * the intervals overlapping a range in O(log n) per result, for
+ * example the mappings of an address space that a new mapping
+ * would collide with. */
+
+/* Interval tree element. */
+struct itree_elem {
+	struct rb_elem elem;        /* Tree element. */
+	uint64_t start;             /* First value in the interval. */
+	uint64_t end;               /* One past the last value. */
+	uint64_t max_end;           /* Largest `end' in this subtree. */
+};
+
+#define itree_entry(ITREE_ELEM, STRUCT, MEMBER)         \
+	((STRUCT *) ((uint8_t *) &(ITREE_ELEM)->start   \
+		- offsetof (STRUCT, MEMBER.start)))
+
+void itree_init (struct rbtree *);
+void itree_insert (struct rbtree *, struct itree_elem *);
+void itree_remove (struct rbtree *, struct itree_elem *);
+struct itree_elem *itree_first (struct rbtree *, uint64_t start,
+		uint64_t end);
+struct itree_elem *itree_next (struct itree_elem *, uint64_t start,
+		uint64_t end);
+
+#endif /* lib/kernel/rbtree.h */
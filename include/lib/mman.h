@@ -0,0 +1,25 @@
+#ifndef __LIB_MMAN_H
+#define __LIB_MMAN_H
+
+/* Memory-mapping flags and advice, shared by the kernel and user
+   programs. */
+
+/* Flags that may be OR'd into mmap()'s WRITABLE argument, whose
+   lowest bit says whether the mapping is writable. */
+#define MAP_POPULATE 0x2        /* Bring the whole mapping in at once. */
+#define MAP_ANON 0x4            /* Not backed by a file: FD and OFFSET are
+                                   ignored and pages start out zeroed. */
+
+/* Advice for madvise(). */
+enum {
+	MADV_NORMAL,                /* No particular access pattern. */
+	MADV_RANDOM,                /* Random access: no read-ahead. */
+	MADV_SEQUENTIAL,            /* Sequential access: read ahead as far
+	                               as possible, drop pages once read. */
+	MADV_WILLNEED,              /* Will be needed soon: read in what fits
+	                               in free memory before returning. */
+	MADV_DONTNEED,              /* Not needed: drop it.  Anonymous pages
+	                               read back as zeros. */
+};
+
+#endif /* lib/mman.h */
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <debug.h>
 #include <stddef.h>
+#include <mman.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -41,6 +42,7 @@ int dup2(int oldfd, int newfd);
 /* Project 3 and optionally project 4. */
 void *mmap (void *addr, size_t length, int writable, int fd, off_t offset);
 void munmap (void *addr);
+bool madvise (void *addr, size_t length, int advice);
 
 /* Project 4 only. */
 bool chdir (const char *dir);
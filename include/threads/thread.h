@@ -113,6 +113,15 @@ struct thread {
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
+
+	/* Owned by vm/vm.c. */
+	size_t ws_size;                     /* Working set, in pages. */
+	unsigned ws_epoch;                  /* Sample that computed WS_SIZE. */
+	struct list_elem ws_elem;           /* Element in a sample's list. */
+	bool suspended;                     /* Suspended by load control? */
+	struct list_elem suspend_elem;      /* Element in suspended list. */
+	void *fault_next;                   /* Page after the last fault-around. */
+	unsigned fault_window;              /* Pages in the last fault-around. */
 #endif
 
 	/* Owned by thread.c. */
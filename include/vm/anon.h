@@ -5,6 +5,7 @@ struct page;
 enum vm_type;
 
 struct anon_page {
+	size_t slot;           /* Swap slot holding the page, or BITMAP_ERROR. */
 };
 
 void vm_anon_init (void);
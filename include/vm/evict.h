@@ -0,0 +1,34 @@
+#ifndef VM_EVICT_H
+#define VM_EVICT_H
+#include <stdbool.h>
+
+struct frame;
+struct page;
+
+/* A page replacement policy.  The policy keeps track of every frame
+ * that holds a page and may be evicted, and picks the one to evict.
+ * All of the hooks are called with the frame table lock held. */
+struct evict_policy {
+	const char *name;
+	/* FRAME was just filled and may be evicted from now on. */
+	void (*insert) (struct frame *);
+	/* FRAME is being freed. */
+	void (*remove) (struct frame *);
+	/* Chooses a frame to evict and stops tracking it.  Returns a null
+	 * pointer if every frame is busy. */
+	struct frame *(*victim) (void);
+	/* PAGE is being destroyed.  May be null. */
+	void (*forget) (struct page *);
+};
+
+extern const struct evict_policy *evict_policy;
+
+bool evict_select (const char *name);
+void evict_init (void);
+void evict_print_stats (void);
+
+/* Provided by vm.c, for the policies. */
+bool frame_test_and_clear_accessed (struct frame *);
+bool frame_is_clean_file (struct frame *);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+#include <stdbool.h>
+#include <stddef.h>
+
+struct disk;
+
+void swap_init (struct disk *);
+size_t swap_write (const void *kva);
+bool swap_read (size_t slot, void *kva);
+void swap_free (size_t slot);
+size_t swap_available (void);
+void swap_batch_begin (size_t page_cnt);
+void swap_batch_end (void);
+void swap_print_stats (void);
+
+#endif
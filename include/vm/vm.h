@@ -1,6 +1,9 @@
 #ifndef VM_VM_H
 #define VM_VM_H
+#include <list.h>
+#include <ohash.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "threads/palloc.h"
 
 enum vm_type {
@@ -46,6 +49,14 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
+	bool writable;         /* May user code write to the page? */
+	struct thread *owner;  /* Process whose address space holds the page. */
+	struct list_elem frame_elem;  /* Element in frame's PAGES list. */
+	bool referenced;       /* Accessed bit saved by working-set sampling. */
+	unsigned ws_sample;    /* Last sample that found the page accessed. */
+	int advice;            /* MADV_NORMAL, MADV_RANDOM or MADV_SEQUENTIAL. */
+	void *mapping;         /* Start of the mmap() region holding the page,
+	                          if it is anonymous, or NULL. */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -59,10 +70,23 @@ struct page {
 	};
 };
 
-/* The representation of "frame" */
+/* The representation of "frame".
+ * After fork, parent and child share each resident frame copy-on-write:
+ * every sharer is on PAGES and maps the frame read-only until its first
+ * write fault gives it a private copy.  PAGE is the first sharer. */
 struct frame {
 	void *kva;
 	struct page *page;
+	struct list pages;     /* Pages mapped to this frame. */
+	size_t ref_cnt;        /* Number of pages in PAGES. */
+	struct list_elem elem; /* Element in an eviction policy list. */
+	struct list_elem table_elem;  /* Element in the frame table. */
+	int queue;             /* Which of the policy's lists. */
+	bool busy;             /* Being filled, copied or evicted? */
+	uint64_t checksum;     /* Contents hash at the last KSM scan. */
+	struct ohash_elem ksm_elem;  /* Element in the KSM table. */
+	bool ksm_listed;       /* In the KSM table? */
+	bool merged;           /* Shared by KSM? */
 };
 
 /* The function table for page operations.
@@ -82,11 +106,23 @@ struct page_operations {
 	if ((page)->operations->destroy) (page)->operations->destroy (page)
 
 /* Representation of current process's memory space.
- * We don't want to force you to obey any specific design for this struct.
- * All designs up to you for this. */
+ * A sparse radix tree shaped like the x86-64 page table: four levels of
+ * 512-entry nodes indexed by the same virtual address bits as the PML4,
+ * page directory pointer table, page directory and page table, with
+ * struct page pointers in the leaves.  Neighbouring pages share a leaf,
+ * so sequential faults and range walks stay within one node. */
 struct supplemental_page_table {
+	void **root;           /* Top-level node, or NULL if empty. */
+	size_t page_cnt;       /* Number of pages in the table. */
+	size_t node_cnt;       /* Number of nodes, including ROOT. */
+	void **leaf;           /* Most recently used leaf node, or NULL. */
+	uintptr_t leaf_va;     /* First address covered by LEAF. */
 };
 
+/* Called by spt_for_each() for each page in a range.  Returns false to
+ * stop the walk. */
+typedef bool spt_action_func (struct page *page, void *aux);
+
 #include "threads/thread.h"
 void supplemental_page_table_init (struct supplemental_page_table *spt);
 bool supplemental_page_table_copy (struct supplemental_page_table *dst,
@@ -96,6 +132,10 @@ struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
+bool spt_for_each (struct supplemental_page_table *spt, void *start,
+		void *end, spt_action_func *action, void *aux);
+void spt_remove_range (struct supplemental_page_table *spt, void *start,
+		void *end);
 
 void vm_init (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
@@ -108,5 +148,13 @@ bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
 enum vm_type page_get_type (struct page *page);
+void vm_free_frame (struct page *page);
+void vm_print_stats (void);
+bool vm_madvise (void *addr, size_t length, int advice);
+bool vm_populate (void *addr, size_t length);
+void *vm_mmap_anon (void *addr, size_t length, int flags);
+
+extern size_t ksm_pages_to_scan;
+extern bool spt_timing;
 
 #endif  /* VM_VM_H */
@@ -0,0 +1,24 @@
+#ifndef VM_ZSMALLOC_H
+#define VM_ZSMALLOC_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "threads/vaddr.h"
+
+/* Largest object zs_malloc() allocates. */
+#define ZS_MAX_SIZE (PGSIZE * 3 / 4)
+
+struct zspage;
+
+/* An allocated object. */
+struct zs_handle {
+	struct zspage *zspage;      /* Group of pages holding it. */
+	unsigned idx;               /* Index within ZSPAGE. */
+};
+
+void zs_init (size_t max_pages);
+bool zs_malloc (size_t size, struct zs_handle *);
+void *zs_map (const struct zs_handle *);
+void zs_free (struct zs_handle *);
+size_t zs_pages (void);
+
+#endif
@@ -63,6 +63,52 @@ last_mask (const struct bitmap *b) {
 	return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns a mask of the bits of the element holding bit START
+   that lie at or after START and before START + CNT, where CNT
+   may run past the end of the element. */
+static inline elem_type
+range_mask (size_t start, size_t cnt) {
+	size_t ofs = start % ELEM_BITS;
+	elem_type mask = (elem_type) -1 << ofs;
+	if (ofs + cnt < ELEM_BITS)
+		mask &= ((elem_type) 1 << (ofs + cnt)) - 1;
+	return mask;
+}
+
+/* Returns the number of set bits in E.  The kernel does not link
+   against libgcc, so __builtin_popcount is not available. */
+static inline size_t
+elem_popcount (elem_type e) {
+	e = e - ((e >> 1) & 0x5555555555555555UL);
+	e = (e & 0x3333333333333333UL) + ((e >> 2) & 0x3333333333333333UL);
+	e = (e + (e >> 4)) & 0x0f0f0f0f0f0f0f0fUL;
+	return (e * 0x0101010101010101UL) >> 56;
+}
+
+/* Returns the index of the first bit in B at or after START that
+   is set to VALUE, or the size of B if there is none.  Whole
+   elements without such a bit are skipped in one step. */
+static size_t
+next_bit (const struct bitmap *b, size_t start, bool value) {
+	elem_type flip = value ? 0 : (elem_type) -1;
+	size_t last = elem_cnt (b->bit_cnt);
+	size_t idx = elem_idx (start);
+	elem_type e;
+	size_t bit;
+
+	if (start >= b->bit_cnt)
+		return b->bit_cnt;
+
+	e = (b->bits[idx] ^ flip) & range_mask (start, ELEM_BITS);
+	while (e == 0) {
+		if (++idx >= last)
+			return b->bit_cnt;
+		e = b->bits[idx] ^ flip;
+	}
+	bit = idx * ELEM_BITS + __builtin_ctzl (e);
+	return bit < b->bit_cnt ? bit : b->bit_cnt;
+}
+
 /* Creation and destruction. */
 
 /* Initializes B to be a bitmap of BIT_CNT bits
@@ -194,50 +240,67 @@ bitmap_set_all (struct bitmap *b, bool value) {
 	bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Each element is updated atomically, but the group as a whole
+   is not. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
-
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		bitmap_set (b, start + i, value);
+	while (cnt > 0) {
+		elem_type *e = &b->bits[elem_idx (start)];
+		elem_type mask = range_mask (start, cnt);
+		size_t done = ELEM_BITS - start % ELEM_BITS;
+
+		/* Same as bitmap_mark() and bitmap_reset(), for every bit
+		   in MASK at once. */
+		if (value)
+			asm ("lock orq %1, %0" : "=m" (*e) : "r" (mask) : "cc");
+		else
+			asm ("lock andq %1, %0" : "=m" (*e) : "r" (~mask) : "cc");
+
+		if (done >= cnt)
+			break;
+		start += done;
+		cnt -= done;
+	}
 }
 
 /* Returns the number of bits in B between START and START + CNT,
    exclusive, that are set to VALUE. */
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i, value_cnt;
+	size_t value_cnt, total = cnt;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
 	value_cnt = 0;
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			value_cnt++;
-	return value_cnt;
+	while (cnt > 0) {
+		elem_type mask = range_mask (start, cnt);
+		size_t done = ELEM_BITS - start % ELEM_BITS;
+
+		value_cnt += elem_popcount (b->bits[elem_idx (start)] & mask);
+		if (done >= cnt)
+			break;
+		start += done;
+		cnt -= done;
+	}
+	return value ? value_cnt : total - value_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
    exclusive, are set to VALUE, and false otherwise. */
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
-
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			return true;
-	return false;
+	return cnt > 0 && next_bit (b, start, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -272,16 +335,47 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 
-	if (cnt <= b->bit_cnt) {
-		size_t last = b->bit_cnt - cnt;
-		size_t i;
-		for (i = start; i <= last; i++)
-			if (!bitmap_contains (b, i, cnt, !value))
-				return i;
+	if (cnt == 0)
+		return start;
+
+	/* Jump from run to run: find the next bit set to VALUE, then
+	   the end of the run it begins. */
+	while (cnt <= b->bit_cnt - start) {
+		size_t run_start = next_bit (b, start, value);
+		size_t run_end;
+
+		if (cnt > b->bit_cnt - run_start)
+			break;
+		run_end = next_bit (b, run_start, !value);
+		if (run_end - run_start >= cnt)
+			return run_start;
+		start = run_end;
 	}
 	return BITMAP_ERROR;
 }
 
+/* Like bitmap_scan(), but searches next-fit: starts at *CURSOR,
+   wraps around to the beginning of B if needed, and on success
+   advances *CURSOR just past the group found.  Keeping *CURSOR
+   between calls avoids rescanning the allocated prefix of B and
+   tends to place successive groups next to each other. */
+size_t
+bitmap_scan_next (const struct bitmap *b, size_t *cursor, size_t cnt,
+		bool value) {
+	size_t start, idx;
+
+	ASSERT (b != NULL);
+	ASSERT (cursor != NULL);
+
+	start = *cursor <= b->bit_cnt ? *cursor : 0;
+	idx = bitmap_scan (b, start, cnt, value);
+	if (idx == BITMAP_ERROR && start > 0)
+		idx = bitmap_scan (b, 0, cnt, value);
+	if (idx != BITMAP_ERROR)
+		*cursor = idx + cnt;
+	return idx;
+}
+
 /* Finds the first group of CNT consecutive bits in B at or after
    START that are all set to VALUE, flips them all to !VALUE,
    and returns the index of the first bit in the group.
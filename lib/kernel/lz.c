@@ -0,0 +1,164 @@
+#include "lz.h"
+#include "../debug.h"
+#include <string.h>
+
+/* Number of bits in a hash table index. */
+#define HASH_BITS 10
+
+/* Reads 4 bytes at P, which need not be aligned. */
+static inline uint32_t
+read32 (const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/* Returns the hash table index for the 4 bytes at P. */
+static inline size_t
+hash4 (const uint8_t *p) {
+	return (read32 (p) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Writes the continuation bytes of length LEN, whose nibble was 15,
+ * at *OP.  Returns false if they would go past OEND. */
+static bool
+put_length (uint8_t **op, uint8_t *oend, size_t len) {
+	for (; len >= 255; len -= 255) {
+		if (*op >= oend)
+			return false;
+		*(*op)++ = 255;
+	}
+	if (*op >= oend)
+		return false;
+	*(*op)++ = len;
+	return true;
+}
+
+/* Writes a run of LIT_LEN literals at LIT followed, if MATCH_LEN is
+ * nonzero, by a match of MATCH_LEN bytes at OFFSET bytes back.  Returns
+ * false if the run would go past OEND. */
+static bool
+put_run (uint8_t **op, uint8_t *oend, const uint8_t *lit, size_t lit_len,
+		size_t offset, size_t match_len) {
+	size_t lit_code = lit_len < 15 ? lit_len : 15;
+	size_t match_code = 0;
+
+	if (match_len > 0) {
+		match_len -= LZ_MIN_MATCH;
+		match_code = match_len < 15 ? match_len : 15;
+	}
+
+	if (*op >= oend)
+		return false;
+	*(*op)++ = (lit_code << 4) | match_code;
+	if (lit_code == 15 && !put_length (op, oend, lit_len - 15))
+		return false;
+	if ((size_t) (oend - *op) < lit_len)
+		return false;
+	memcpy (*op, lit, lit_len);
+	*op += lit_len;
+
+	if (offset == 0)
+		return true;
+	if (oend - *op < 2)
+		return false;
+	*(*op)++ = offset;
+	*(*op)++ = offset >> 8;
+	return match_code < 15 || put_length (op, oend, match_len - 15);
+}
+
+/* Compresses the SRC_LEN bytes at SRC into the DST_CAP bytes at DST,
+ * using WORK, which must hold LZ_WORK_SIZE bytes, as scratch space.
+ * Returns the compressed length, or 0 if it would exceed DST_CAP. */
+size_t
+lz_compress (const void *src_, size_t src_len, void *dst_, size_t dst_cap,
+		void *work) {
+	const uint8_t *src = src_;
+	const uint8_t *end = src + src_len;
+	const uint8_t *ip = src, *anchor = src;
+	uint8_t *dst = dst_, *op = dst, *oend = dst + dst_cap;
+	uint16_t *table = work;
+
+	ASSERT (src_len <= LZ_MAX_LEN);
+
+	memset (table, 0, LZ_WORK_SIZE);
+	while (src_len >= LZ_MIN_MATCH && ip <= end - LZ_MIN_MATCH) {
+		size_t h = hash4 (ip);
+		const uint8_t *ref = src + table[h];
+		size_t len;
+
+		table[h] = ip - src;
+		if (ref >= ip || read32 (ref) != read32 (ip)) {
+			ip++;
+			continue;
+		}
+
+		for (len = LZ_MIN_MATCH; ip + len < end && ref[len] == ip[len]; len++)
+			continue;
+		if (!put_run (&op, oend, anchor, ip - anchor, ip - ref, len))
+			return 0;
+		ip += len;
+		anchor = ip;
+	}
+	if (!put_run (&op, oend, anchor, end - anchor, 0, 0))
+		return 0;
+	return op - dst;
+}
+
+/* Reads the continuation bytes of a length whose nibble was 15 from
+ * *IP, adding them to *LEN.  Returns false if they go past IEND. */
+static bool
+get_length (const uint8_t **ip, const uint8_t *iend, size_t *len) {
+	uint8_t b;
+
+	do {
+		if (*ip >= iend)
+			return false;
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+	return true;
+}
+
+/* Decompresses the SRC_LEN bytes at SRC, produced by lz_compress(), into
+ * the DST_LEN bytes at DST.  Returns true if successful, false if SRC is
+ * corrupt or does not decompress to exactly DST_LEN bytes. */
+bool
+lz_decompress (const void *src, size_t src_len, void *dst_, size_t dst_len) {
+	const uint8_t *ip = src, *iend = ip + src_len;
+	uint8_t *dst = dst_, *op = dst, *oend = dst + dst_len;
+
+	for (;;) {
+		uint8_t token;
+		size_t lit_len, match_len, offset;
+
+		if (ip >= iend)
+			return false;
+		token = *ip++;
+		lit_len = token >> 4;
+		match_len = token & 15;
+		if (lit_len == 15 && !get_length (&ip, iend, &lit_len))
+			return false;
+		if (lit_len > (size_t) (iend - ip) || lit_len > (size_t) (oend - op))
+			return false;
+		memcpy (op, ip, lit_len);
+		ip += lit_len;
+		op += lit_len;
+
+		/* The last run has no match. */
+		if (ip == iend)
+			return op == oend;
+		if (iend - ip < 2)
+			return false;
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (match_len == 15 && !get_length (&ip, iend, &match_len))
+			return false;
+		match_len += LZ_MIN_MATCH;
+		if (offset == 0 || offset > (size_t) (op - dst)
+				|| match_len > (size_t) (oend - op))
+			return false;
+
+		/* The match may overlap the bytes it produces. */
+		for (; match_len > 0; match_len--, op++)
+			*op = op[-offset];
+	}
+}
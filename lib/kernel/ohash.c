@@ -0,0 +1,496 @@
+/* Open-addressing hash table.
+
+   See ohash.h for basic information.
+
+   The array uses linear probing: an element with hash value H
+   lives in the first slot at or after H % slot_cnt that was free
+   when it was inserted, and a search stops at the first empty
+   slot.  Deleting from the current array shifts later elements of
+   the same run back into the hole, so the array never needs
+   "deleted" markers.
+
+   To resize, ohash allocates a new array and makes it current,
+   keeping the old one around.  Each insertion or deletion then
+   moves the next DRAIN_STEP slots of the old array, in index
+   order, into the current one, and the old array is freed once
+   all of its slots have been moved.  Nothing is ever inserted
+   into the old array, and an element deleted from it is replaced
+   by a TOMBSTONE instead of shifting its neighbours, so that every
+   element still in the old array stays at or above OLD_IDX and
+   stays reachable from its home slot. */
+
+#include "ohash.h"
+#include "../debug.h"
+#include <string.h>
+#include "threads/malloc.h"
+
+/* Fewest slots in a table. */
+#define MIN_SLOTS 8
+
+/* Slots of the old array moved per insertion or deletion. */
+#define DRAIN_STEP 8
+
+/* Marks a slot of the old array whose element was deleted. */
+#define TOMBSTONE ((struct ohash_elem *) 1)
+
+static bool is_elem (const struct ohash_slot *);
+static bool equal (struct ohash *, const struct ohash_elem *,
+		const struct ohash_elem *);
+static struct ohash_slot *find_slot (struct ohash *, uint64_t hash,
+		const struct ohash_elem *);
+static struct ohash_slot *find_old_slot (struct ohash *, uint64_t hash,
+		const struct ohash_elem *);
+static void place (struct ohash *, uint64_t hash, struct ohash_elem *);
+static void remove_slot (struct ohash *, struct ohash_slot *);
+static bool start_resize (struct ohash *, size_t slot_cnt);
+static void drain (struct ohash *, size_t slot_cnt);
+static void grow (struct ohash *);
+
+/* Initializes hash table H to compute hash values using HASH and
+   compare hash elements using LESS, given auxiliary data AUX. */
+bool
+ohash_init (struct ohash *h,
+		ohash_hash_func *hash, ohash_less_func *less, void *aux) {
+	h->elem_cnt = 0;
+	h->slot_cnt = MIN_SLOTS;
+	h->slots = calloc (h->slot_cnt, sizeof *h->slots);
+	h->old_slot_cnt = 0;
+	h->old_slots = NULL;
+	h->old_idx = 0;
+	h->hash = hash;
+	h->less = less;
+	h->aux = aux;
+	return h->slots != NULL;
+}
+
+/* Removes all the elements from H.
+
+   If DESTRUCTOR is non-null, then it is called for each element
+   in the hash.  DESTRUCTOR may, if appropriate, deallocate the
+   memory used by the hash element.  However, modifying hash
+   table H while ohash_clear() is running, using any of the
+   functions ohash_clear(), ohash_destroy(), ohash_insert(),
+   ohash_replace(), or ohash_delete(), yields undefined behavior,
+   whether done in DESTRUCTOR or elsewhere. */
+void
+ohash_clear (struct ohash *h, ohash_action_func *destructor) {
+	if (destructor != NULL)
+		ohash_apply (h, destructor);
+
+	free (h->old_slots);
+	h->old_slots = NULL;
+	h->old_slot_cnt = 0;
+	h->old_idx = 0;
+	memset (h->slots, 0, h->slot_cnt * sizeof *h->slots);
+	h->elem_cnt = 0;
+}
+
+/* Destroys hash table H.
+
+   If DESTRUCTOR is non-null, then it is first called for each
+   element in the hash, as in ohash_clear(). */
+void
+ohash_destroy (struct ohash *h, ohash_action_func *destructor) {
+	if (destructor != NULL)
+		ohash_apply (h, destructor);
+	free (h->old_slots);
+	free (h->slots);
+}
+
+/* Inserts NEW into hash table H and returns a null pointer, if
+   no equal element is already in the table.
+   If an equal element is already in the table, returns it
+   without inserting NEW. */
+struct ohash_elem *
+ohash_insert (struct ohash *h, struct ohash_elem *new) {
+	uint64_t hash = h->hash (new, h->aux);
+	struct ohash_slot *s;
+
+	drain (h, DRAIN_STEP);
+	s = find_slot (h, hash, new);
+	if (s == NULL)
+		s = find_old_slot (h, hash, new);
+	if (s != NULL)
+		return s->elem;
+
+	grow (h);
+	place (h, hash, new);
+	h->elem_cnt++;
+	return NULL;
+}
+
+/* Inserts NEW into hash table H, replacing any equal element
+   already in the table, which is returned. */
+struct ohash_elem *
+ohash_replace (struct ohash *h, struct ohash_elem *new) {
+	uint64_t hash = h->hash (new, h->aux);
+	struct ohash_slot *s;
+	struct ohash_elem *old;
+
+	drain (h, DRAIN_STEP);
+	s = find_slot (h, hash, new);
+	if (s == NULL)
+		s = find_old_slot (h, hash, new);
+	if (s != NULL) {
+		old = s->elem;
+		s->elem = new;
+		new->hash = hash;
+		return old;
+	}
+
+	grow (h);
+	place (h, hash, new);
+	h->elem_cnt++;
+	return NULL;
+}
+
+/* Finds and returns an element equal to E in hash table H, or a
+   null pointer if no equal element exists in the table. */
+struct ohash_elem *
+ohash_find (struct ohash *h, struct ohash_elem *e) {
+	uint64_t hash = h->hash (e, h->aux);
+	struct ohash_slot *s = find_slot (h, hash, e);
+
+	if (s == NULL)
+		s = find_old_slot (h, hash, e);
+	return s != NULL ? s->elem : NULL;
+}
+
+/* Finds, removes, and returns an element equal to E in hash
+   table H.  Returns a null pointer if no equal element existed
+   in the table.
+
+   If the elements of the hash table are dynamically allocated,
+   or own resources that are, then it is the caller's
+   responsibility to deallocate them. */
+struct ohash_elem *
+ohash_delete (struct ohash *h, struct ohash_elem *e) {
+	uint64_t hash = h->hash (e, h->aux);
+	struct ohash_elem *found = NULL;
+	struct ohash_slot *s;
+
+	drain (h, DRAIN_STEP);
+	s = find_slot (h, hash, e);
+	if (s != NULL) {
+		found = s->elem;
+		remove_slot (h, s);
+	} else {
+		s = find_old_slot (h, hash, e);
+		if (s != NULL) {
+			found = s->elem;
+			s->elem = TOMBSTONE;
+		}
+	}
+	if (found == NULL)
+		return NULL;
+
+	/* Shrink once the table is less than 1/8 full. */
+	h->elem_cnt--;
+	if (h->old_slots == NULL && h->slot_cnt > MIN_SLOTS
+			&& h->elem_cnt < h->slot_cnt / 8)
+		start_resize (h, h->slot_cnt / 2);
+	return found;
+}
+
+/* Calls ACTION for each element in hash table H in arbitrary
+   order.
+   Modifying hash table H while ohash_apply() is running, using
+   any of the functions ohash_clear(), ohash_destroy(),
+   ohash_insert(), ohash_replace(), or ohash_delete(), yields
+   undefined behavior, whether done from ACTION or elsewhere. */
+void
+ohash_apply (struct ohash *h, ohash_action_func *action) {
+	struct ohash_iterator i;
+
+	ASSERT (action != NULL);
+
+	ohash_first (&i, h);
+	while (ohash_next (&i))
+		action (ohash_cur (&i), h->aux);
+}
+
+/* Initializes I for iterating hash table H.
+
+   Iteration idiom:
+
+   struct ohash_iterator i;
+
+   ohash_first (&i, h);
+   while (ohash_next (&i))
+   {
+   struct foo *f = ohash_entry (ohash_cur (&i), struct foo, elem);
+   ...do something with f...
+   }
+
+   Modifying hash table H during iteration, using any of the
+   functions ohash_clear(), ohash_destroy(), ohash_insert(),
+   ohash_replace(), or ohash_delete(), invalidates all
+   iterators. */
+void
+ohash_first (struct ohash_iterator *i, struct ohash *h) {
+	ASSERT (i != NULL);
+	ASSERT (h != NULL);
+
+	i->hash = h;
+	i->pos = h->old_idx;
+	i->elem = NULL;
+}
+
+/* Advances I to the next element in the hash table and returns
+   it.  Returns a null pointer if no elements are left.  Elements
+   are returned in arbitrary order. */
+struct ohash_elem *
+ohash_next (struct ohash_iterator *i) {
+	struct ohash *h;
+
+	ASSERT (i != NULL);
+
+	h = i->hash;
+	for (; i->pos < h->old_slot_cnt + h->slot_cnt; i->pos++) {
+		struct ohash_slot *s = (i->pos < h->old_slot_cnt
+				? &h->old_slots[i->pos]
+				: &h->slots[i->pos - h->old_slot_cnt]);
+		if (is_elem (s)) {
+			i->pos++;
+			i->elem = s->elem;
+			return i->elem;
+		}
+	}
+	i->elem = NULL;
+	return NULL;
+}
+
+/* Returns the current element in the hash table iteration, or a
+   null pointer at the end of the table.  Undefined behavior
+   after calling ohash_first() but before ohash_next(). */
+struct ohash_elem *
+ohash_cur (struct ohash_iterator *i) {
+	return i->elem;
+}
+
+/* Returns the number of elements in H. */
+size_t
+ohash_size (struct ohash *h) {
+	return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+ohash_empty (struct ohash *h) {
+	return h->elem_cnt == 0;
+}
+
+/* Multipliers from xxHash64. */
+#define PRIME_1 0x9e3779b185ebca87ULL
+#define PRIME_2 0xc2b2ae3d27d4eb4fULL
+
+/* A 64-bit word that may sit at any address. */
+typedef uint64_t unaligned_u64 __attribute__ ((aligned (1), may_alias));
+
+/* Mixes the bits of X so that every input bit affects every
+   output bit (the MurmurHash3 finalizer). */
+static inline uint64_t
+mix (uint64_t x) {
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+/* Returns a hash of the SIZE bytes in BUF.  Consumes eight bytes
+   per step, where hash_bytes() takes one. */
+uint64_t
+ohash_bytes (const void *buf_, size_t size) {
+	const uint8_t *buf = buf_;
+	uint64_t hash = PRIME_2 ^ size;
+	uint64_t tail = 0;
+
+	ASSERT (buf != NULL);
+
+	for (; size >= 8; buf += 8, size -= 8) {
+		hash ^= *(const unaligned_u64 *) buf * PRIME_1;
+		hash = ((hash << 31) | (hash >> 33)) * PRIME_2;
+	}
+	while (size-- > 0)
+		tail = (tail << 8) | buf[size];
+	return mix (hash ^ tail * PRIME_1);
+}
+
+/* Returns a hash of string S. */
+uint64_t
+ohash_string (const char *s) {
+	ASSERT (s != NULL);
+	return ohash_bytes (s, strlen (s));
+}
+
+/* Returns a hash of integer I. */
+uint64_t
+ohash_int (int i) {
+	return mix ((uint64_t) (unsigned) i * PRIME_1);
+}
+
+/* Returns a hash of X, for instance an address. */
+uint64_t
+ohash_u64 (uint64_t x) {
+	return mix (x * PRIME_1);
+}
+
+/* Returns true if slot S holds an element. */
+static bool
+is_elem (const struct ohash_slot *s) {
+	return s->elem != NULL && s->elem != TOMBSTONE;
+}
+
+/* Returns true if A and B are equal according to H's comparison
+   function. */
+static bool
+equal (struct ohash *h, const struct ohash_elem *a,
+		const struct ohash_elem *b) {
+	return !h->less (a, b, h->aux) && !h->less (b, a, h->aux);
+}
+
+/* Returns the slot of the current array of H that holds an
+   element equal to E, whose hash value is HASH, or a null pointer
+   if there is none. */
+static struct ohash_slot *
+find_slot (struct ohash *h, uint64_t hash, const struct ohash_elem *e) {
+	size_t mask = h->slot_cnt - 1;
+	size_t i;
+
+	for (i = hash & mask; h->slots[i].elem != NULL; i = (i + 1) & mask) {
+		struct ohash_slot *s = &h->slots[i];
+		if (s->hash == hash && equal (h, s->elem, e))
+			return s;
+	}
+	return NULL;
+}
+
+/* Returns the slot of the array being drained that holds an
+   element equal to E, whose hash value is HASH, or a null pointer
+   if there is none.  Slots below OLD_IDX have already been moved,
+   so the search steps over them rather than stopping there. */
+static struct ohash_slot *
+find_old_slot (struct ohash *h, uint64_t hash,
+		const struct ohash_elem *e) {
+	size_t mask = h->old_slot_cnt - 1;
+	size_t i, n;
+
+	if (h->old_slots == NULL)
+		return NULL;
+
+	for (i = hash & mask, n = 0; n < h->old_slot_cnt; i = (i + 1) & mask, n++) {
+		struct ohash_slot *s = &h->old_slots[i];
+		if (i < h->old_idx)
+			continue;
+		if (s->elem == NULL)
+			break;
+		if (s->elem != TOMBSTONE && s->hash == hash && equal (h, s->elem, e))
+			return s;
+	}
+	return NULL;
+}
+
+/* Puts E, whose hash value is HASH, into the first empty slot at
+   or after its home slot in H's current array, which must have
+   one. */
+static void
+place (struct ohash *h, uint64_t hash, struct ohash_elem *e) {
+	size_t mask = h->slot_cnt - 1;
+	size_t i;
+
+	for (i = hash & mask; h->slots[i].elem != NULL; i = (i + 1) & mask)
+		continue;
+	h->slots[i].hash = hash;
+	h->slots[i].elem = e;
+	e->hash = hash;
+}
+
+/* Empties slot S of H's current array, moving later elements of
+   the same run back so that none of them ends up separated from
+   its home slot by an empty slot. */
+static void
+remove_slot (struct ohash *h, struct ohash_slot *s) {
+	size_t mask = h->slot_cnt - 1;
+	size_t hole = s - h->slots;
+	size_t i = hole;
+
+	for (;;) {
+		size_t home;
+
+		i = (i + 1) & mask;
+		if (h->slots[i].elem == NULL)
+			break;
+
+		/* The element at I may move into the hole only if its
+		   home slot is not in the cyclic range (HOLE, I]. */
+		home = h->slots[i].hash & mask;
+		if (hole <= i ? (hole < home && home <= i)
+				: (hole < home || home <= i))
+			continue;
+		h->slots[hole] = h->slots[i];
+		hole = i;
+	}
+	h->slots[hole].elem = NULL;
+}
+
+/* Makes a new, empty array of SLOT_CNT slots current in H and
+   starts draining the old one into it.  Returns false if memory
+   is not available, in which case H is unchanged. */
+static bool
+start_resize (struct ohash *h, size_t slot_cnt) {
+	struct ohash_slot *slots;
+
+	ASSERT (h->old_slots == NULL);
+
+	slots = calloc (slot_cnt, sizeof *slots);
+	if (slots == NULL)
+		return false;
+
+	h->old_slots = h->slots;
+	h->old_slot_cnt = h->slot_cnt;
+	h->old_idx = 0;
+	h->slots = slots;
+	h->slot_cnt = slot_cnt;
+	return true;
+}
+
+/* Moves up to SLOT_CNT slots of the array being drained, if any,
+   into H's current array, and frees the old array once it is
+   empty. */
+static void
+drain (struct ohash *h, size_t slot_cnt) {
+	if (h->old_slots == NULL)
+		return;
+
+	for (; slot_cnt > 0 && h->old_idx < h->old_slot_cnt; slot_cnt--) {
+		struct ohash_slot *s = &h->old_slots[h->old_idx++];
+		if (is_elem (s))
+			place (h, s->hash, s->elem);
+	}
+
+	if (h->old_idx == h->old_slot_cnt) {
+		free (h->old_slots);
+		h->old_slots = NULL;
+		h->old_slot_cnt = 0;
+		h->old_idx = 0;
+	}
+}
+
+/* Makes room for one more element in H.  The current array is
+   doubled once it would be more than 3/4 full.  If memory for that
+   is not available, H keeps filling the current array, and panics
+   only when it has no empty slot left. */
+static void
+grow (struct ohash *h) {
+	if ((h->elem_cnt + 1) * 4 <= h->slot_cnt * 3)
+		return;
+
+	/* Finish any resize in progress first; it cannot normally
+	   still be running by the time the new array fills up. */
+	drain (h, SIZE_MAX);
+	if (!start_resize (h, h->slot_cnt * 2)
+			&& h->elem_cnt + 1 >= h->slot_cnt)
+		PANIC ("ohash: out of memory");
+}
@@ -0,0 +1,188 @@
+#include "pairing_heap.h"
+#include "../debug.h"
+
+/* A pairing heap is a tree in which no element is less than its
+   parent, with any number of children per element.  Children are
+   kept in a doubly linked sibling list hanging off their parent's
+   `child' pointer; the first child's `prev' points back to the
+   parent, which lets an element anywhere in the tree be cut out
+   in O(1).
+
+   Pushing melds the new element with the top: whichever is less
+   becomes the top and the other becomes its first child.  Popping
+   the top leaves its children as a list of subtrees, which are
+   melded back together in two passes: first in pairs from left to
+   right, then the pairs from right to left into one tree.  That
+   two-pass scheme is what gives pop its O(log n) amortized cost. */
+
+/* Melds the heaps rooted at A and B, neither of which may have
+   siblings, and returns the new root. */
+static struct pairing_heap_elem *
+meld (struct pairing_heap *heap,
+		struct pairing_heap_elem *a, struct pairing_heap_elem *b) {
+	if (heap->less (b, a, heap->aux)) {
+		struct pairing_heap_elem *t = a;
+		a = b;
+		b = t;
+	}
+
+	b->prev = a;
+	b->next = a->child;
+	if (a->child != NULL)
+		a->child->prev = b;
+	a->child = b;
+	return a;
+}
+
+/* Melds the sibling list starting at FIRST into a single tree and
+   returns its root, or a null pointer if FIRST is null. */
+static struct pairing_heap_elem *
+merge_pairs (struct pairing_heap *heap, struct pairing_heap_elem *first) {
+	struct pairing_heap_elem *stack = NULL;
+	struct pairing_heap_elem *root;
+
+	/* Left to right: meld adjacent pairs, pushing each result on
+	   a stack linked through `next'. */
+	while (first != NULL) {
+		struct pairing_heap_elem *a = first;
+		struct pairing_heap_elem *b = a->next;
+
+		first = b != NULL ? b->next : NULL;
+		a->next = a->prev = NULL;
+		if (b != NULL) {
+			b->next = b->prev = NULL;
+			a = meld (heap, a, b);
+		}
+		a->next = stack;
+		stack = a;
+	}
+	if (stack == NULL)
+		return NULL;
+
+	/* Right to left: meld the pairs into one tree. */
+	root = stack;
+	stack = stack->next;
+	root->next = NULL;
+	while (stack != NULL) {
+		struct pairing_heap_elem *next = stack->next;
+		stack->next = NULL;
+		root = meld (heap, root, stack);
+		stack = next;
+	}
+	root->prev = root->next = NULL;
+	return root;
+}
+
+/* Unlinks E, which must not be the top, from its parent and
+   siblings, leaving E's own subtree intact. */
+static void
+cut (struct pairing_heap_elem *e) {
+	if (e->prev->child == e)
+		e->prev->child = e->next;
+	else
+		e->prev->next = e->next;
+	if (e->next != NULL)
+		e->next->prev = e->prev;
+	e->prev = e->next = NULL;
+}
+
+/* Initializes HEAP as an empty heap ordered by LESS given
+   auxiliary data AUX. */
+void
+pairing_heap_init (struct pairing_heap *heap,
+		pairing_heap_less_func *less, void *aux) {
+	ASSERT (heap != NULL);
+	ASSERT (less != NULL);
+
+	heap->top = NULL;
+	heap->elem_cnt = 0;
+	heap->less = less;
+	heap->aux = aux;
+}
+
+/* Inserts ELEM into HEAP. */
+void
+pairing_heap_push (struct pairing_heap *heap,
+		struct pairing_heap_elem *elem) {
+	ASSERT (elem != NULL);
+
+	elem->child = elem->next = elem->prev = NULL;
+	heap->top = heap->top != NULL ? meld (heap, heap->top, elem) : elem;
+	heap->elem_cnt++;
+}
+
+/* Removes and returns the top element of HEAP, which must not be
+   empty. */
+struct pairing_heap_elem *
+pairing_heap_pop (struct pairing_heap *heap) {
+	struct pairing_heap_elem *top = heap->top;
+
+	ASSERT (top != NULL);
+
+	heap->top = merge_pairs (heap, top->child);
+	heap->elem_cnt--;
+	top->child = NULL;
+	return top;
+}
+
+/* Removes ELEM, which must be in HEAP, from HEAP. */
+void
+pairing_heap_remove (struct pairing_heap *heap,
+		struct pairing_heap_elem *elem) {
+	struct pairing_heap_elem *sub;
+
+	ASSERT (elem != NULL);
+
+	if (elem == heap->top) {
+		pairing_heap_pop (heap);
+		return;
+	}
+
+	cut (elem);
+	sub = merge_pairs (heap, elem->child);
+	if (sub != NULL)
+		heap->top = meld (heap, heap->top, sub);
+	heap->elem_cnt--;
+	elem->child = NULL;
+}
+
+/* Moves ELEM, which is in HEAP, toward the top after its key has
+   become less than before.  Takes O(1) time. */
+void
+pairing_heap_decrease (struct pairing_heap *heap,
+		struct pairing_heap_elem *elem) {
+	ASSERT (elem != NULL);
+
+	if (elem == heap->top)
+		return;
+	cut (elem);
+	heap->top = meld (heap, heap->top, elem);
+}
+
+/* Puts ELEM, which is in HEAP, back in order after its key has
+   changed in either direction. */
+void
+pairing_heap_update (struct pairing_heap *heap,
+		struct pairing_heap_elem *elem) {
+	pairing_heap_remove (heap, elem);
+	pairing_heap_push (heap, elem);
+}
+
+/* Returns the top element of HEAP, or a null pointer if HEAP is
+   empty. */
+struct pairing_heap_elem *
+pairing_heap_top (struct pairing_heap *heap) {
+	return heap->top;
+}
+
+/* Returns the number of elements in HEAP. */
+size_t
+pairing_heap_size (struct pairing_heap *heap) {
+	return heap->elem_cnt;
+}
+
+/* Returns true if HEAP is empty, false otherwise. */
+bool
+pairing_heap_empty (struct pairing_heap *heap) {
+	return heap->top == NULL;
+}
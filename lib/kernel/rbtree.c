@@ -0,0 +1,526 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+/* The tree follows the usual red-black rules, with null pointers
+   standing in for the black leaves:
+
+   1. The root is black.
+   2. A red element has no red child.
+   3. Every path from an element down to a null leaf passes the
+      same number of black elements.
+
+   Together these keep the longest path from the root at most
+   twice as long as the shortest, so the height is O(log n).
+
+   When the tree is augmented, an element's data depends only on
+   its own subtree.  A rotation changes the subtrees of just the
+   two elements it rotates, and linking or unlinking an element
+   changes the subtrees along the path from there to the root, so
+   those are the only elements handed to the update function. */
+
+static void change_child (struct rbtree *, struct rb_elem *parent,
+		struct rb_elem *old, struct rb_elem *new);
+static void rotate_left (struct rbtree *, struct rb_elem *);
+static void rotate_right (struct rbtree *, struct rb_elem *);
+static void update_path (struct rbtree *, struct rb_elem *);
+static void insert_fixup (struct rbtree *, struct rb_elem *);
+static void remove_fixup (struct rbtree *, struct rb_elem *x,
+		struct rb_elem *parent);
+
+/* Returns true if E is a red element.  Null leaves are black. */
+static inline bool
+is_red (const struct rb_elem *e) {
+	return e != NULL && e->red;
+}
+
+/* Returns the leftmost element in the subtree rooted at E. */
+static inline struct rb_elem *
+leftmost (struct rb_elem *e) {
+	while (e->left != NULL)
+		e = e->left;
+	return e;
+}
+
+/* Returns the rightmost element in the subtree rooted at E. */
+static inline struct rb_elem *
+rightmost (struct rb_elem *e) {
+	while (e->right != NULL)
+		e = e->right;
+	return e;
+}
+
+/* Initializes TREE as an empty tree ordered by LESS.  If UPDATE
+   is non-null, the tree is augmented and calls UPDATE to keep
+   each element's augmented data current.  AUX is passed to both
+   functions. */
+void
+rbtree_init (struct rbtree *tree,
+		rb_less_func *less, rb_update_func *update, void *aux) {
+	ASSERT (tree != NULL);
+	ASSERT (less != NULL);
+
+	tree->root = NULL;
+	tree->elem_cnt = 0;
+	tree->less = less;
+	tree->update = update;
+	tree->aux = aux;
+}
+
+/* Inserts ELEM into TREE, after any elements equal to it. */
+void
+rbtree_insert (struct rbtree *tree, struct rb_elem *elem) {
+	struct rb_elem *parent = NULL;
+	struct rb_elem **link = &tree->root;
+
+	ASSERT (elem != NULL);
+
+	while (*link != NULL) {
+		parent = *link;
+		link = (tree->less (elem, parent, tree->aux)
+				? &parent->left : &parent->right);
+	}
+
+	elem->parent = parent;
+	elem->left = elem->right = NULL;
+	elem->red = true;
+	*link = elem;
+	tree->elem_cnt++;
+
+	update_path (tree, elem);
+	insert_fixup (tree, elem);
+}
+
+/* Removes ELEM, which must be in TREE, from TREE. */
+void
+rbtree_remove (struct rbtree *tree, struct rb_elem *elem) {
+	struct rb_elem *y, *x, *parent;
+	bool removed_red;
+
+	ASSERT (elem != NULL);
+	ASSERT (tree->elem_cnt > 0);
+
+	/* Y is the element that actually leaves its place in the tree:
+	   ELEM itself if it has at most one child, otherwise its
+	   successor, which has no left child and takes ELEM's place.
+	   X is the child that moves up into Y's old place. */
+	y = (elem->left == NULL || elem->right == NULL
+			? elem : leftmost (elem->right));
+	x = y->left != NULL ? y->left : y->right;
+	parent = y->parent;
+	removed_red = y->red;
+
+	change_child (tree, parent, y, x);
+	if (parent == elem)
+		parent = y;
+	if (x != NULL)
+		x->parent = parent;
+
+	if (y != elem) {
+		y->parent = elem->parent;
+		y->left = elem->left;
+		y->right = elem->right;
+		y->red = elem->red;
+		change_child (tree, elem->parent, elem, y);
+		if (y->left != NULL)
+			y->left->parent = y;
+		if (y->right != NULL)
+			y->right->parent = y;
+	}
+	tree->elem_cnt--;
+
+	if (parent != NULL)
+		update_path (tree, parent);
+	if (!removed_red)
+		remove_fixup (tree, x, parent);
+}
+
+/* Removes and returns the smallest element in TREE, which must
+   not be empty. */
+struct rb_elem *
+rbtree_pop_min (struct rbtree *tree) {
+	struct rb_elem *min = rbtree_min (tree);
+
+	ASSERT (min != NULL);
+	rbtree_remove (tree, min);
+	return min;
+}
+
+/* Returns the first element in TREE equal to KEY, or a null
+   pointer if there is none. */
+struct rb_elem *
+rbtree_find (struct rbtree *tree, const struct rb_elem *key) {
+	struct rb_elem *e = rbtree_lower_bound (tree, key);
+
+	return e != NULL && !tree->less (key, e, tree->aux) ? e : NULL;
+}
+
+/* Returns the first element in TREE that is not less than KEY,
+   or a null pointer if every element is less than KEY. */
+struct rb_elem *
+rbtree_lower_bound (struct rbtree *tree, const struct rb_elem *key) {
+	struct rb_elem *e = tree->root;
+	struct rb_elem *found = NULL;
+
+	ASSERT (key != NULL);
+
+	while (e != NULL)
+		if (tree->less (e, key, tree->aux))
+			e = e->right;
+		else {
+			found = e;
+			e = e->left;
+		}
+	return found;
+}
+
+/* Returns the smallest element in TREE, or a null pointer if
+   TREE is empty. */
+struct rb_elem *
+rbtree_min (struct rbtree *tree) {
+	return tree->root != NULL ? leftmost (tree->root) : NULL;
+}
+
+/* Returns the largest element in TREE, or a null pointer if
+   TREE is empty. */
+struct rb_elem *
+rbtree_max (struct rbtree *tree) {
+	return tree->root != NULL ? rightmost (tree->root) : NULL;
+}
+
+/* Returns the element after ELEM in its tree, or a null pointer
+   if ELEM is the largest. */
+struct rb_elem *
+rbtree_next (struct rb_elem *elem) {
+	ASSERT (elem != NULL);
+
+	if (elem->right != NULL)
+		return leftmost (elem->right);
+	while (elem->parent != NULL && elem == elem->parent->right)
+		elem = elem->parent;
+	return elem->parent;
+}
+
+/* Returns the element before ELEM in its tree, or a null pointer
+   if ELEM is the smallest. */
+struct rb_elem *
+rbtree_prev (struct rb_elem *elem) {
+	ASSERT (elem != NULL);
+
+	if (elem->left != NULL)
+		return rightmost (elem->left);
+	while (elem->parent != NULL && elem == elem->parent->left)
+		elem = elem->parent;
+	return elem->parent;
+}
+
+/* Returns the number of elements in TREE. */
+size_t
+rbtree_size (struct rbtree *tree) {
+	return tree->elem_cnt;
+}
+
+/* Returns true if TREE is empty, false otherwise. */
+bool
+rbtree_empty (struct rbtree *tree) {
+	return tree->root == NULL;
+}
+
+/* Makes NEW take OLD's place as a child of PARENT, or as the root
+   of TREE if PARENT is null. */
+static void
+change_child (struct rbtree *tree, struct rb_elem *parent,
+		struct rb_elem *old, struct rb_elem *new) {
+	if (parent == NULL)
+		tree->root = new;
+	else if (parent->left == old)
+		parent->left = new;
+	else
+		parent->right = new;
+}
+
+/* Rotates X's right child up into X's place:
+
+       X                Y
+      / \              / \
+     a   Y     =>     X   c
+        / \          / \
+       b   c        a   b
+*/
+static void
+rotate_left (struct rbtree *tree, struct rb_elem *x) {
+	struct rb_elem *y = x->right;
+
+	x->right = y->left;
+	if (y->left != NULL)
+		y->left->parent = x;
+	y->parent = x->parent;
+	change_child (tree, x->parent, x, y);
+	y->left = x;
+	x->parent = y;
+
+	if (tree->update != NULL) {
+		tree->update (x, tree->aux);
+		tree->update (y, tree->aux);
+	}
+}
+
+/* Rotates X's left child up into X's place; the mirror image of
+   rotate_left(). */
+static void
+rotate_right (struct rbtree *tree, struct rb_elem *x) {
+	struct rb_elem *y = x->left;
+
+	x->left = y->right;
+	if (y->right != NULL)
+		y->right->parent = x;
+	y->parent = x->parent;
+	change_child (tree, x->parent, x, y);
+	y->right = x;
+	x->parent = y;
+
+	if (tree->update != NULL) {
+		tree->update (x, tree->aux);
+		tree->update (y, tree->aux);
+	}
+}
+
+/* Recomputes the augmented data of E and all of its ancestors in
+   augmented TREE. */
+static void
+update_path (struct rbtree *tree, struct rb_elem *e) {
+	if (tree->update == NULL)
+		return;
+	for (; e != NULL; e = e->parent)
+		tree->update (e, tree->aux);
+}
+
+/* Restores the red-black rules after red element E has been
+   linked into TREE. */
+static void
+insert_fixup (struct rbtree *tree, struct rb_elem *e) {
+	struct rb_elem *parent;
+
+	while ((parent = e->parent) != NULL && parent->red) {
+		/* PARENT is red, so it is not the root and has a parent. */
+		struct rb_elem *grandparent = parent->parent;
+
+		if (parent == grandparent->left) {
+			struct rb_elem *uncle = grandparent->right;
+			if (is_red (uncle)) {
+				parent->red = uncle->red = false;
+				grandparent->red = true;
+				e = grandparent;
+				continue;
+			}
+			if (e == parent->right) {
+				rotate_left (tree, parent);
+				parent = e;
+			}
+			parent->red = false;
+			grandparent->red = true;
+			rotate_right (tree, grandparent);
+			break;
+		} else {
+			struct rb_elem *uncle = grandparent->left;
+			if (is_red (uncle)) {
+				parent->red = uncle->red = false;
+				grandparent->red = true;
+				e = grandparent;
+				continue;
+			}
+			if (e == parent->left) {
+				rotate_right (tree, parent);
+				parent = e;
+			}
+			parent->red = false;
+			grandparent->red = true;
+			rotate_left (tree, grandparent);
+			break;
+		}
+	}
+	tree->root->red = false;
+}
+
+/* Restores the red-black rules after a black element has been
+   unlinked from TREE.  X, which may be a null leaf, took its
+   place under PARENT and is short one black element on each of
+   its paths. */
+static void
+remove_fixup (struct rbtree *tree, struct rb_elem *x,
+		struct rb_elem *parent) {
+	while (x != tree->root && !is_red (x)) {
+		/* X is short a black element, so its sibling W has at
+		   least one black element on each path and is not null. */
+		if (x == parent->left) {
+			struct rb_elem *w = parent->right;
+			if (w->red) {
+				w->red = false;
+				parent->red = true;
+				rotate_left (tree, parent);
+				w = parent->right;
+			}
+			if (!is_red (w->left) && !is_red (w->right)) {
+				w->red = true;
+				x = parent;
+				parent = x->parent;
+				continue;
+			}
+			if (!is_red (w->right)) {
+				w->left->red = false;
+				w->red = true;
+				rotate_right (tree, w);
+				w = parent->right;
+			}
+			w->red = parent->red;
+			parent->red = false;
+			w->right->red = false;
+			rotate_left (tree, parent);
+		} else {
+			struct rb_elem *w = parent->left;
+			if (w->red) {
+				w->red = false;
+				parent->red = true;
+				rotate_right (tree, parent);
+				w = parent->left;
+			}
+			if (!is_red (w->left) && !is_red (w->right)) {
+				w->red = true;
+				x = parent;
+				parent = x->parent;
+				continue;
+			}
+			if (!is_red (w->left)) {
+				w->right->red = false;
+				w->red = true;
+				rotate_left (tree, w);
+				w = parent->left;
+			}
+			w->red = parent->red;
+			parent->red = false;
+			w->left->red = false;
+			rotate_right (tree, parent);
+		}
+		x = tree->root;
+	}
+	if (x != NULL)
+		x->red = false;
+}
+
+/* Interval tree. */
+
+static inline struct itree_elem *
+to_itree (const struct rb_elem *e) {
+	return rbtree_entry (e, struct itree_elem, elem);
+}
+
+/* rb_less_func for interval trees: orders by start. */
+static bool
+itree_less (const struct rb_elem *a, const struct rb_elem *b,
+		void *aux UNUSED) {
+	return to_itree (a)->start < to_itree (b)->start;
+}
+
+/* rb_update_func for interval trees: computes max_end. */
+static void
+itree_update (struct rb_elem *e, void *aux UNUSED) {
+	struct itree_elem *i = to_itree (e);
+	uint64_t max_end = i->end;
+
+	if (e->left != NULL && to_itree (e->left)->max_end > max_end)
+		max_end = to_itree (e->left)->max_end;
+	if (e->right != NULL && to_itree (e->right)->max_end > max_end)
+		max_end = to_itree (e->right)->max_end;
+	i->max_end = max_end;
+}
+
+/* Returns the lowest-starting interval in the subtree rooted at
+   E that overlaps [START, END), or a null pointer if none does. */
+static struct itree_elem *
+subtree_first (struct rb_elem *e, uint64_t start, uint64_t end) {
+	while (e != NULL) {
+		struct itree_elem *i = to_itree (e);
+
+		if (i->max_end <= start)
+			return NULL;
+
+		/* If anything on the left reaches START, the answer is
+		   there or nowhere: everything from E on starts no
+		   earlier than the intervals on the left. */
+		if (e->left != NULL && to_itree (e->left)->max_end > start) {
+			e = e->left;
+			continue;
+		}
+		if (i->start >= end)
+			return NULL;
+		if (i->end > start)
+			return i;
+		e = e->right;
+	}
+	return NULL;
+}
+
+/* Initializes TREE as an empty interval tree. */
+void
+itree_init (struct rbtree *tree) {
+	rbtree_init (tree, itree_less, itree_update, NULL);
+}
+
+/* Inserts interval I, whose START and END must be set, into
+   interval tree TREE.  Intervals may overlap. */
+void
+itree_insert (struct rbtree *tree, struct itree_elem *i) {
+	ASSERT (i->start < i->end);
+
+	i->max_end = i->end;
+	rbtree_insert (tree, &i->elem);
+}
+
+/* Removes interval I from interval tree TREE. */
+void
+itree_remove (struct rbtree *tree, struct itree_elem *i) {
+	rbtree_remove (tree, &i->elem);
+}
+
+/* Returns the lowest-starting interval in TREE that overlaps
+   [START, END), or a null pointer if none does. */
+struct itree_elem *
+itree_first (struct rbtree *tree, uint64_t start, uint64_t end) {
+	return subtree_first (tree->root, start, end);
+}
+
+/* Returns the interval after I, in order of start, that overlaps
+   [START, END), or a null pointer if there is none.  I is
+   usually a result of itree_first() or itree_next() for the same
+   range.  The following idiom visits every interval in TREE that
+   overlaps [START, END):
+
+   for (i = itree_first (tree, start, end); i != NULL;
+        i = itree_next (i, start, end))
+     ...do something with i...
+*/
+struct itree_elem *
+itree_next (struct itree_elem *i, uint64_t start, uint64_t end) {
+	struct rb_elem *e = &i->elem;
+
+	for (;;) {
+		struct rb_elem *prev;
+
+		/* Later intervals in E's right subtree come first. */
+		if (e->right != NULL && to_itree (e->right)->max_end > start)
+			return subtree_first (e->right, start, end);
+
+		/* Otherwise climb to the next element in order. */
+		do {
+			prev = e;
+			e = e->parent;
+			if (e == NULL)
+				return NULL;
+		} while (prev == e->right);
+
+		i = to_itree (e);
+		if (i->start >= end)
+			return NULL;
+		if (i->end > start)
+			return i;
+	}
+}
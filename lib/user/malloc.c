@@ -0,0 +1,298 @@
+#include <stdlib.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+
+/* A simple malloc() for user programs.
+
+   Memory comes from a heap that starts on the page after the
+   program's bss and grows upward, at least HEAP_GROW pages at a
+   time, by mapping anonymous memory there with mmap().  Free
+   pages are kept on a list of runs in address order, allocated
+   first fit and coalesced when freed.  The heap never shrinks.
+
+   As in the kernel's malloc(), small requests are rounded up to
+   a power of 2, from 16 bytes to 1 kB, and each of those size
+   classes carves single-page arenas into blocks that it keeps on
+   a free list.  An arena whose blocks are all free again goes
+   back to the heap.  Bigger requests get a run of whole pages.
+   Either way a block finds its arena, whose header says how big
+   the block is, by rounding its address down to a page. */
+
+#define PAGE_SIZE 4096          /* Bytes per page. */
+#define MIN_SIZE 16             /* Smallest block. */
+#define CLASS_CNT 7             /* Size classes: 16, 32, ..., 1024. */
+#define HEAP_GROW 16            /* Fewest pages added to the heap. */
+
+/* Start of every arena. */
+struct arena {
+	unsigned magic;             /* Detects corruption. */
+	size_t block_size;          /* Size of each block, or 0 if the
+	                               arena holds one big block. */
+	size_t page_cnt;            /* Pages in the arena. */
+	size_t free_cnt;            /* Free blocks in the arena. */
+};
+
+/* Magic number for detecting arena corruption. */
+#define ARENA_MAGIC 0x9a548eed
+
+/* A free block. */
+struct block {
+	struct block *prev;         /* Previous free block of its size. */
+	struct block *next;         /* Next free block of its size. */
+};
+
+/* A run of free pages. */
+struct run {
+	struct run *next;           /* Next run, at a higher address. */
+	size_t page_cnt;            /* Pages in this run. */
+};
+
+static struct block *free_blocks[CLASS_CNT];  /* Free blocks, by class. */
+static struct run *free_runs;   /* Free pages. */
+static uint8_t *heap_end;       /* End of the heap. */
+
+/* End of the program's bss, from the linker script. */
+extern char _end[];
+
+static void pages_put (void *, size_t page_cnt);
+
+/* Grows the heap by at least PAGE_CNT pages and returns the first
+   PAGE_CNT of them, or a null pointer if mmap() fails. */
+static void *
+heap_grow (size_t page_cnt) {
+	size_t grow_cnt = page_cnt > HEAP_GROW ? page_cnt : HEAP_GROW;
+	uint8_t *base;
+
+	if (heap_end == NULL)
+		heap_end = (uint8_t *) ROUND_UP ((uintptr_t) _end, PAGE_SIZE);
+	base = heap_end;
+	if (mmap (base, grow_cnt * PAGE_SIZE, true | MAP_ANON, -1, 0) != base)
+		return NULL;
+	heap_end += grow_cnt * PAGE_SIZE;
+	if (grow_cnt > page_cnt)
+		pages_put (base + page_cnt * PAGE_SIZE, grow_cnt - page_cnt);
+	return base;
+}
+
+/* Returns PAGE_CNT contiguous free pages, or a null pointer if
+   there are none and the heap cannot grow. */
+static void *
+pages_get (size_t page_cnt) {
+	struct run **rp, *r;
+
+	for (rp = &free_runs; (r = *rp) != NULL; rp = &r->next)
+		if (r->page_cnt >= page_cnt) {
+			if (r->page_cnt > page_cnt) {
+				struct run *rest = (struct run *) ((uint8_t *) r
+						+ page_cnt * PAGE_SIZE);
+				rest->next = r->next;
+				rest->page_cnt = r->page_cnt - page_cnt;
+				*rp = rest;
+			} else
+				*rp = r->next;
+			return r;
+		}
+	return heap_grow (page_cnt);
+}
+
+/* Returns the PAGE_CNT pages at PAGES to the free runs. */
+static void
+pages_put (void *pages, size_t page_cnt) {
+	struct run *r = pages, *prev = NULL, *next = free_runs;
+
+	while (next != NULL && next < r) {
+		prev = next;
+		next = next->next;
+	}
+	r->page_cnt = page_cnt;
+	r->next = next;
+	if (next != NULL
+			&& (uint8_t *) r + page_cnt * PAGE_SIZE == (uint8_t *) next) {
+		r->page_cnt += next->page_cnt;
+		r->next = next->next;
+	}
+	if (prev != NULL
+			&& (uint8_t *) prev + prev->page_cnt * PAGE_SIZE == (uint8_t *) r) {
+		prev->page_cnt += r->page_cnt;
+		prev->next = r->next;
+	} else if (prev != NULL)
+		prev->next = r;
+	else
+		free_runs = r;
+}
+
+/* Returns the arena that block B is in. */
+static struct arena *
+block_to_arena (void *b) {
+	struct arena *a = (struct arena *) ((uintptr_t) b & ~(PAGE_SIZE - 1));
+
+	ASSERT (a->magic == ARENA_MAGIC);
+	return a;
+}
+
+/* Returns the number of blocks of BLOCK_SIZE bytes in an arena. */
+static size_t
+blocks_per_arena (size_t block_size) {
+	return (PAGE_SIZE - sizeof (struct arena)) / block_size;
+}
+
+/* Returns block IDX of arena A. */
+static struct block *
+arena_block (struct arena *a, size_t idx) {
+	return (struct block *) ((uint8_t *) (a + 1) + idx * a->block_size);
+}
+
+/* Pushes B onto the free list of class C. */
+static void
+block_push (size_t c, struct block *b) {
+	b->prev = NULL;
+	b->next = free_blocks[c];
+	if (b->next != NULL)
+		b->next->prev = b;
+	free_blocks[c] = b;
+}
+
+/* Removes B from the free list of class C. */
+static void
+block_remove (size_t c, struct block *b) {
+	if (b->prev != NULL)
+		b->prev->next = b->next;
+	else
+		free_blocks[c] = b->next;
+	if (b->next != NULL)
+		b->next->prev = b->prev;
+}
+
+/* Returns the usable size of the block at P. */
+static size_t
+block_size (void *p) {
+	struct arena *a = block_to_arena (p);
+
+	return (a->block_size != 0 ? a->block_size
+			: a->page_cnt * PAGE_SIZE - sizeof *a);
+}
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size) {
+	struct arena *a;
+	struct block *b;
+	size_t c, i;
+
+	if (size == 0)
+		return NULL;
+
+	/* Big block: a run of pages of its own. */
+	if (size > (size_t) MIN_SIZE << (CLASS_CNT - 1)) {
+		size_t page_cnt;
+
+		if (size > SIZE_MAX - sizeof *a - PAGE_SIZE)
+			return NULL;
+		page_cnt = DIV_ROUND_UP (size + sizeof *a, PAGE_SIZE);
+		a = pages_get (page_cnt);
+		if (a == NULL)
+			return NULL;
+		a->magic = ARENA_MAGIC;
+		a->block_size = 0;
+		a->page_cnt = page_cnt;
+		a->free_cnt = 0;
+		return a + 1;
+	}
+
+	for (c = 0; (size_t) MIN_SIZE << c < size; c++)
+		continue;
+	if (free_blocks[c] == NULL) {
+		a = pages_get (1);
+		if (a == NULL)
+			return NULL;
+		a->magic = ARENA_MAGIC;
+		a->block_size = (size_t) MIN_SIZE << c;
+		a->page_cnt = 1;
+		a->free_cnt = blocks_per_arena (a->block_size);
+		for (i = 0; i < a->free_cnt; i++)
+			block_push (c, arena_block (a, i));
+	}
+
+	b = free_blocks[c];
+	block_remove (c, b);
+	block_to_arena (b)->free_cnt--;
+	return b;
+}
+
+/* Allocates and returns A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b) {
+	void *p;
+	size_t size = a * b;
+
+	if (b != 0 && size / b != a)
+		return NULL;
+	p = malloc (size);
+	if (p != NULL)
+		memset (p, 0, size);
+	return p;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly moving
+   it in the process.  If successful, returns the new block; on
+   failure, returns a null pointer.  A call with null OLD_BLOCK is
+   equivalent to malloc(NEW_SIZE).  A call with zero NEW_SIZE is
+   equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size) {
+	size_t old_size;
+	void *new_block;
+
+	if (new_size == 0) {
+		free (old_block);
+		return NULL;
+	}
+	if (old_block == NULL)
+		return malloc (new_size);
+
+	old_size = block_size (old_block);
+	if (new_size <= old_size)
+		return old_block;
+	new_block = malloc (new_size);
+	if (new_block != NULL) {
+		memcpy (new_block, old_block, old_size);
+		free (old_block);
+	}
+	return new_block;
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p) {
+	struct arena *a;
+	size_t c, i, cnt;
+
+	if (p == NULL)
+		return;
+
+	a = block_to_arena (p);
+	if (a->block_size == 0) {
+		a->magic = 0;
+		pages_put (a, a->page_cnt);
+		return;
+	}
+
+	for (c = 0; (size_t) MIN_SIZE << c < a->block_size; c++)
+		continue;
+	block_push (c, p);
+
+	/* Give the arena back once all of its blocks are free. */
+	cnt = blocks_per_arena (a->block_size);
+	if (++a->free_cnt == cnt) {
+		for (i = 0; i < cnt; i++)
+			block_remove (c, arena_block (a, i));
+		a->magic = 0;
+		pages_put (a, 1);
+	}
+}
@@ -155,6 +155,11 @@ munmap (void *addr) {
 	syscall1 (SYS_MUNMAP, addr);
 }
 
+bool
+madvise (void *addr, size_t length, int advice) {
+	return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
 bool
 chdir (const char *dir) {
 	return syscall1 (SYS_CHDIR, dir);
@@ -0,0 +1,146 @@
+/* Test program for lib/kernel/bitmap.c.
+
+   Checks the word-at-a-time counting and scanning functions
+   against bit-by-bit reference loops on random bitmaps, then
+   times bitmap_scan() on a page-pool-sized bitmap whose front is
+   allocated and whose tail is fragmented, which is the case that
+   dominates palloc_get_multiple() on a busy pool.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+#include "intrinsic.h"
+
+/* Maximum number of bits in a bitmap that we will test. */
+#define MAX_SIZE 700
+
+/* Number of bits in the timed bitmap, about 128 MB of pages. */
+#define POOL_SIZE 32768
+
+static void verify (struct bitmap *, size_t size);
+static void time_scan (void);
+
+/* Test the bitmap implementation. */
+void
+test (void) 
+{
+  int repeat;
+
+  printf ("testing random bitmaps:");
+  for (repeat = 0; repeat < 100; repeat++) 
+    {
+      size_t size = random_ulong () % MAX_SIZE;
+      struct bitmap *b = bitmap_create (size);
+      int op;
+
+      ASSERT (b != NULL);
+      for (op = 0; op < 100; op++) 
+        {
+          size_t start = random_ulong () % (size + 1);
+          size_t cnt = random_ulong () % (size - start + 1);
+          bitmap_set_multiple (b, start, cnt, random_ulong () % 2);
+          verify (b, size);
+        }
+      bitmap_destroy (b);
+      printf (".");
+    }
+  printf (" done\n");
+
+  time_scan ();
+  printf ("bitmap: PASS\n");
+}
+
+/* Returns the number of bits in B from START to START + CNT that
+   are set to VALUE, one bit at a time. */
+static size_t
+slow_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+{
+  size_t i, value_cnt = 0;
+
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (b, start + i) == value)
+      value_cnt++;
+  return value_cnt;
+}
+
+/* Returns the start of the first group of CNT bits in B at or
+   after START that are all VALUE, one position at a time. */
+static size_t
+slow_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+{
+  size_t i;
+
+  for (i = start; i + cnt <= bitmap_size (b); i++)
+    if (slow_count (b, i, cnt, value) == cnt)
+      return i;
+  return BITMAP_ERROR;
+}
+
+/* Checks counting and scanning on B, which has SIZE bits, at a
+   few random positions. */
+static void
+verify (struct bitmap *b, size_t size) 
+{
+  int i;
+
+  ASSERT (bitmap_size (b) == size);
+  for (i = 0; i < 10; i++) 
+    {
+      size_t start = random_ulong () % (size + 1);
+      size_t cnt = random_ulong () % (size - start + 1);
+      size_t group = random_ulong () % 16;
+      size_t cursor = start;
+      bool value = random_ulong () % 2;
+      size_t expected;
+
+      ASSERT (bitmap_count (b, start, cnt, value)
+              == slow_count (b, start, cnt, value));
+      ASSERT (bitmap_contains (b, start, cnt, value)
+              == (slow_count (b, start, cnt, value) > 0));
+
+      expected = slow_scan (b, start, group, value);
+      ASSERT (bitmap_scan (b, start, group, value) == expected);
+
+      if (expected == BITMAP_ERROR && start > 0)
+        expected = slow_scan (b, 0, group, value);
+      ASSERT (bitmap_scan_next (b, &cursor, group, value) == expected);
+      ASSERT (expected == BITMAP_ERROR || cursor == expected + group);
+    }
+}
+
+/* Times bitmap_scan() for free groups of 1 and 8 bits in a pool
+   that is three quarters full, with every other bit of the last
+   quarter free. */
+static void
+time_scan (void) 
+{
+  struct bitmap *b = bitmap_create (POOL_SIZE);
+  size_t cnt, i;
+
+  ASSERT (b != NULL);
+  bitmap_set_multiple (b, 0, POOL_SIZE / 4 * 3, true);
+  for (i = POOL_SIZE / 4 * 3; i < POOL_SIZE; i += 2)
+    bitmap_mark (b, i);
+
+  for (cnt = 1; cnt <= 8; cnt *= 8) 
+    {
+      uint64_t start = rdtsc ();
+      int repeat;
+
+      /* Single free bits start right after the full prefix; there
+         is no free run of 8 at all. */
+      for (repeat = 0; repeat < 16; repeat++)
+        ASSERT (bitmap_scan (b, 0, cnt, false)
+                == (cnt == 1 ? POOL_SIZE / 4 * 3 + 1 : BITMAP_ERROR));
+      printf ("scan of %zu-bit pool for %zu free: %llu cycles\n",
+              (size_t) POOL_SIZE, cnt, (rdtsc () - start) / 16);
+    }
+  bitmap_destroy (b);
+}
@@ -0,0 +1,121 @@
+/* Test program for lib/kernel/lz.c.
+
+   Compresses buffers of various sizes and kinds of content,
+   checking that each one decompresses to the original, that
+   compressible data actually shrinks, and that the decompressor
+   rejects truncated input.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <lz.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/test.h"
+
+/* Largest buffer tested. */
+#define MAX_LEN 8192
+
+/* Kinds of content. */
+enum content
+  {
+    ZEROS,                      /* All zeros. */
+    RANDOM,                     /* Incompressible. */
+    SMALL_ALPHABET,             /* Random bytes from a few values. */
+    REPEATS,                    /* Random snippets, repeated. */
+    COUNTING,                   /* Sorted 32-bit integers. */
+    CONTENT_CNT
+  };
+
+static uint8_t original[MAX_LEN];
+static uint8_t compressed[MAX_LEN * 2];
+static uint8_t restored[MAX_LEN];
+static uint8_t work[LZ_WORK_SIZE];
+
+static void fill (enum content, size_t len);
+static size_t round_trip (size_t len);
+
+/* Test the compressor. */
+void
+test (void)
+{
+  static const size_t lens[] = {0, 1, 3, 4, 5, 15, 16, 100, 255, 270,
+                                4096, MAX_LEN};
+  size_t i;
+  int c;
+
+  for (c = 0; c < CONTENT_CNT; c++)
+    for (i = 0; i < sizeof lens / sizeof *lens; i++)
+      {
+        size_t len = lens[i];
+        size_t clen;
+
+        fill (c, len);
+        clen = round_trip (len);
+        if (len >= 4096 && (c == ZEROS || c == REPEATS))
+          ASSERT (clen < len / 4);
+      }
+
+  /* Output that does not fit is reported as a failure. */
+  fill (RANDOM, 4096);
+  ASSERT (lz_compress (original, 4096, compressed, 4096, work) == 0);
+
+  printf ("lz: PASS\n");
+}
+
+/* Fills the first LEN bytes of ORIGINAL with content of kind C. */
+static void
+fill (enum content c, size_t len)
+{
+  size_t i;
+
+  switch (c)
+    {
+    case ZEROS:
+      memset (original, 0, len);
+      break;
+    case RANDOM:
+      for (i = 0; i < len; i++)
+        original[i] = random_ulong ();
+      break;
+    case SMALL_ALPHABET:
+      for (i = 0; i < len; i++)
+        original[i] = "abcd"[random_ulong () % 4];
+      break;
+    case REPEATS:
+      for (i = 0; i < len; i++)
+        original[i] = random_ulong ();
+      for (i = 64; i + 16 <= len; i += 16)
+        memcpy (original + i, original + random_ulong () % 48, 16);
+      break;
+    case COUNTING:
+      for (i = 0; i < len; i++)
+        original[i] = (i / 4 * 3) >> (8 * (i % 4));
+      break;
+    default:
+      NOT_REACHED ();
+    }
+}
+
+/* Compresses and decompresses the first LEN bytes of ORIGINAL,
+   checks the result, and returns the compressed length. */
+static size_t
+round_trip (size_t len)
+{
+  size_t clen = lz_compress (original, len, compressed, sizeof compressed,
+                             work);
+
+  ASSERT (clen > 0);
+  memset (restored, 0xcc, sizeof restored);
+  ASSERT (lz_decompress (compressed, clen, restored, len));
+  ASSERT (memcmp (original, restored, len) == 0);
+
+  /* A wrong output length or a missing byte is caught. */
+  ASSERT (!lz_decompress (compressed, clen, restored, len + 1));
+  ASSERT (len == 0 || !lz_decompress (compressed, clen - 1, restored, len));
+  return clen;
+}
@@ -0,0 +1,138 @@
+/* Test program for the page-table code in threads/mmu.c.
+
+   Builds address spaces shaped like a small user process, copies
+   them the way fork does, checks the copies, and tears both down
+   the way exit does.  Reports the cost of the first round, which
+   has to get its page tables from palloc, and of the later
+   rounds, which are served from the page-table cache.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <stdio.h>
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "threads/test.h"
+#include "intrinsic.h"
+
+/* Layout of the simulated process. */
+#define CODE_BASE 0x400000
+#define CODE_PAGES 8
+#define STACK_PAGES 2
+
+/* Number of fork/exit rounds. */
+#define ROUNDS 64
+
+static uint64_t *spawn (void);
+static uint64_t *fork_space (uint64_t *);
+static bool copy_page (uint64_t *pte, void *va, void *aux);
+static void map_page (uint64_t *, uint64_t va);
+static void verify (uint64_t *);
+
+/* Test page-table creation, copying, and destruction. */
+void
+test (void)
+{
+  uint64_t first = 0, rest = 0;
+  int i;
+
+  for (i = 0; i < ROUNDS; i++)
+    {
+      uint64_t start = rdtsc ();
+      uint64_t *parent = spawn ();
+      uint64_t *child = fork_space (parent);
+      uint64_t cycles;
+
+      verify (parent);
+      verify (child);
+      pml4_destroy (child);
+      pml4_destroy (parent);
+
+      cycles = rdtsc () - start;
+      if (i == 0)
+        first = cycles;
+      else
+        rest += cycles;
+    }
+
+  printf ("fork/exit round: first %llu cycles, then %llu cycles\n",
+          first, rest / (ROUNDS - 1));
+  pml4_print_stats ();
+  printf ("mmu: PASS\n");
+}
+
+/* Returns a new address space with a text segment and a stack,
+   each page holding its own virtual address. */
+static uint64_t *
+spawn (void)
+{
+  uint64_t *pml4 = pml4_create ();
+  int i;
+
+  ASSERT (pml4 != NULL);
+  for (i = 0; i < CODE_PAGES; i++)
+    map_page (pml4, CODE_BASE + i * PGSIZE);
+  for (i = 1; i <= STACK_PAGES; i++)
+    map_page (pml4, USER_STACK - i * PGSIZE);
+  return pml4;
+}
+
+/* Maps user page VA in PML4 to a new frame holding VA. */
+static void
+map_page (uint64_t *pml4, uint64_t va)
+{
+  uint64_t *kpage = palloc_get_page (PAL_USER);
+
+  ASSERT (kpage != NULL);
+  *kpage = va;
+  ASSERT (pml4_set_page (pml4, (void *) va, kpage, true));
+}
+
+/* Returns a copy of the user part of PARENT. */
+static uint64_t *
+fork_space (uint64_t *parent)
+{
+  uint64_t *child = pml4_create ();
+
+  ASSERT (child != NULL);
+  ASSERT (pml4_for_each (parent, copy_page, child));
+  return child;
+}
+
+/* pml4_for_each() helper for fork_space(). */
+static bool
+copy_page (uint64_t *pte, void *va, void *child)
+{
+  uint64_t *kpage;
+
+  if (is_kern_pte (pte))
+    return true;
+
+  kpage = palloc_get_page (PAL_USER);
+  ASSERT (kpage != NULL);
+  *kpage = *(uint64_t *) ptov (pte_get_paddr (pte));
+  return pml4_set_page (child, va, kpage, is_writable (pte));
+}
+
+/* Checks that every page of the simulated process is mapped in
+   PML4 and holds its own address. */
+static void
+verify (uint64_t *pml4)
+{
+  int i;
+
+  for (i = 0; i < CODE_PAGES + STACK_PAGES; i++)
+    {
+      uint64_t va = (i < CODE_PAGES
+                     ? CODE_BASE + i * PGSIZE
+                     : USER_STACK - (i - CODE_PAGES + 1) * PGSIZE);
+      uint64_t *kpage = pml4_get_page (pml4, (void *) va);
+
+      ASSERT (kpage != NULL);
+      ASSERT (*kpage == va);
+    }
+}
@@ -0,0 +1,151 @@
+/* Test program for lib/kernel/ohash.c.
+
+   Inserts, replaces, and deletes random keys, checking the table
+   against a plain array after every operation.  The key count
+   swings up and down, so the table grows and shrinks many times,
+   and most operations land while an old array is still being
+   drained.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <ohash.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Number of distinct keys. */
+#define KEY_CNT 1024
+
+/* Number of random operations. */
+#define OP_CNT 100000
+
+/* A key in the table. */
+struct key
+  {
+    struct ohash_elem elem;
+    int value;
+  };
+
+static struct key keys[KEY_CNT];
+static struct key alt_keys[KEY_CNT];
+
+/* Which copy of each key is in the table, or NULL. */
+static struct key *present[KEY_CNT];
+
+static uint64_t key_hash (const struct ohash_elem *, void *);
+static bool key_less (const struct ohash_elem *, const struct ohash_elem *,
+                      void *);
+static void verify (struct ohash *, size_t cnt);
+
+/* Test the open-addressing hash table. */
+void
+test (void)
+{
+  struct ohash h;
+  size_t cnt = 0;
+  int op;
+
+  ASSERT (ohash_init (&h, key_hash, key_less, NULL));
+  for (op = 0; op < KEY_CNT; op++)
+    keys[op].value = alt_keys[op].value = op;
+
+  for (op = 0; op < OP_CNT; op++)
+    {
+      /* Favor insertion in the first half of every 16384
+         operations and deletion in the second half. */
+      bool filling = (op / 8192) % 2 == 0;
+      int i = random_ulong () % KEY_CNT;
+      int action = random_ulong () % 8;
+
+      if (action < 4 + (filling ? 2 : -2))
+        {
+          struct ohash_elem *old = ohash_insert (&h, &keys[i].elem);
+          if (present[i] == NULL)
+            {
+              ASSERT (old == NULL);
+              present[i] = &keys[i];
+              cnt++;
+            }
+          else
+            ASSERT (old == &present[i]->elem);
+        }
+      else if (action == 7)
+        {
+          struct key *new = present[i] == &keys[i] ? &alt_keys[i] : &keys[i];
+          struct ohash_elem *old = ohash_replace (&h, &new->elem);
+          ASSERT (present[i] == NULL ? old == NULL : old == &present[i]->elem);
+          if (present[i] == NULL)
+            cnt++;
+          present[i] = new;
+        }
+      else
+        {
+          struct ohash_elem *old = ohash_delete (&h, &keys[i].elem);
+          ASSERT (present[i] == NULL ? old == NULL : old == &present[i]->elem);
+          if (present[i] != NULL)
+            cnt--;
+          present[i] = NULL;
+        }
+
+      if (op % 64 == 0)
+        verify (&h, cnt);
+    }
+
+  verify (&h, cnt);
+  ohash_clear (&h, NULL);
+  verify (&h, 0);
+  ohash_destroy (&h, NULL);
+  printf ("ohash: PASS\n");
+}
+
+/* Checks that H holds exactly the CNT keys recorded in
+   PRESENT[]. */
+static void
+verify (struct ohash *h, size_t cnt)
+{
+  struct ohash_iterator it;
+  size_t seen = 0;
+  int i;
+
+  if (cnt == 0)
+    for (i = 0; i < KEY_CNT; i++)
+      present[i] = NULL;
+
+  ASSERT (ohash_size (h) == cnt);
+  ASSERT (ohash_empty (h) == (cnt == 0));
+  for (i = 0; i < KEY_CNT; i++)
+    {
+      struct ohash_elem *e = ohash_find (h, &keys[i].elem);
+      ASSERT (present[i] == NULL ? e == NULL : e == &present[i]->elem);
+    }
+
+  ohash_first (&it, h);
+  while (ohash_next (&it))
+    {
+      struct key *k = ohash_entry (ohash_cur (&it), struct key, elem);
+      ASSERT (present[k->value] == k);
+      seen++;
+    }
+  ASSERT (seen == cnt);
+}
+
+/* Returns the hash of the key containing E. */
+static uint64_t
+key_hash (const struct ohash_elem *e, void *aux UNUSED)
+{
+  return ohash_int (ohash_entry (e, struct key, elem)->value);
+}
+
+/* Returns true if the key containing A is less than the one
+   containing B. */
+static bool
+key_less (const struct ohash_elem *a, const struct ohash_elem *b,
+          void *aux UNUSED)
+{
+  return (ohash_entry (a, struct key, elem)->value
+          < ohash_entry (b, struct key, elem)->value);
+}
@@ -0,0 +1,217 @@
+/* Test program for lib/kernel/pairing_heap.c.
+
+   Pushes, pops, removes, and reprioritizes random elements,
+   checking every pop against a brute-force minimum.  Then times
+   a ready-queue-like workload on a list kept sorted with
+   list_insert_ordered(), on an rbtree, and on a pairing heap.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <list.h>
+#include <pairing_heap.h>
+#include <random.h>
+#include <rbtree.h>
+#include <stdio.h>
+#include "threads/test.h"
+#include "intrinsic.h"
+
+/* Number of elements. */
+#define ELEM_CNT 512
+
+/* Number of random operations in the correctness test. */
+#define OP_CNT 20000
+
+/* Queue lengths for the benchmark. */
+static const int bench_sizes[] = {8, 64, 512};
+
+/* Operations per benchmark run. */
+#define BENCH_OPS 4096
+
+/* An element that can be in any of the three containers. */
+struct value
+  {
+    struct pairing_heap_elem heap_elem;
+    struct rb_elem rb_elem;
+    struct list_elem list_elem;
+    int value;
+    bool in_heap;
+  };
+
+static struct value values[ELEM_CNT];
+
+static void test_heap (void);
+static void bench (int size);
+static struct value *min_value (void);
+static bool heap_less (const struct pairing_heap_elem *,
+                       const struct pairing_heap_elem *, void *);
+static bool rb_less (const struct rb_elem *, const struct rb_elem *, void *);
+static bool list_less (const struct list_elem *, const struct list_elem *,
+                       void *);
+
+/* Test the pairing heap and compare it to the alternatives. */
+void
+test (void)
+{
+  size_t i;
+
+  test_heap ();
+  for (i = 0; i < sizeof bench_sizes / sizeof *bench_sizes; i++)
+    bench (bench_sizes[i]);
+  printf ("pairing_heap: PASS\n");
+}
+
+/* Runs random operations on a heap and checks every top. */
+static void
+test_heap (void)
+{
+  struct pairing_heap heap;
+  size_t cnt = 0;
+  int op;
+
+  pairing_heap_init (&heap, heap_less, NULL);
+  for (op = 0; op < OP_CNT; op++)
+    {
+      struct value *v = &values[random_ulong () % ELEM_CNT];
+      int action = random_ulong () % 4;
+
+      if (!v->in_heap)
+        {
+          v->value = random_ulong () % 1000;
+          pairing_heap_push (&heap, &v->heap_elem);
+          v->in_heap = true;
+          cnt++;
+        }
+      else if (action == 0)
+        {
+          struct value *top = min_value ();
+          struct value *popped = pairing_heap_entry (pairing_heap_pop (&heap),
+                                                     struct value, heap_elem);
+          ASSERT (popped->value == top->value);
+          popped->in_heap = false;
+          cnt--;
+        }
+      else if (action == 1)
+        {
+          pairing_heap_remove (&heap, &v->heap_elem);
+          v->in_heap = false;
+          cnt--;
+        }
+      else if (action == 2)
+        {
+          v->value -= random_ulong () % 100;
+          pairing_heap_decrease (&heap, &v->heap_elem);
+        }
+      else
+        {
+          v->value = random_ulong () % 1000;
+          pairing_heap_update (&heap, &v->heap_elem);
+        }
+
+      ASSERT (pairing_heap_size (&heap) == cnt);
+      ASSERT (cnt > 0
+              ? (pairing_heap_entry (pairing_heap_top (&heap), struct value,
+                                     heap_elem)->value == min_value ()->value)
+              : pairing_heap_empty (&heap));
+    }
+
+  while (!pairing_heap_empty (&heap))
+    pairing_heap_entry (pairing_heap_pop (&heap), struct value,
+                        heap_elem)->in_heap = false;
+}
+
+/* Times BENCH_OPS rounds of "take the front, requeue it with a
+   new key" on queues holding SIZE elements, as a scheduler's
+   ready queue does. */
+static void
+bench (int size)
+{
+  struct list list;
+  struct rbtree tree;
+  struct pairing_heap heap;
+  uint64_t start, list_cycles, rb_cycles, heap_cycles;
+  int i;
+
+  list_init (&list);
+  rbtree_init (&tree, rb_less, NULL, NULL);
+  pairing_heap_init (&heap, heap_less, NULL);
+  for (i = 0; i < size; i++)
+    {
+      values[i].value = random_ulong () % 64;
+      list_insert_ordered (&list, &values[i].list_elem, list_less, NULL);
+      rbtree_insert (&tree, &values[i].rb_elem);
+      pairing_heap_push (&heap, &values[i].heap_elem);
+    }
+
+  start = rdtsc ();
+  for (i = 0; i < BENCH_OPS; i++)
+    {
+      struct list_elem *e = list_pop_front (&list);
+      list_entry (e, struct value, list_elem)->value += i % 64;
+      list_insert_ordered (&list, e, list_less, NULL);
+    }
+  list_cycles = rdtsc () - start;
+
+  start = rdtsc ();
+  for (i = 0; i < BENCH_OPS; i++)
+    {
+      struct rb_elem *e = rbtree_pop_min (&tree);
+      rbtree_entry (e, struct value, rb_elem)->value += i % 64;
+      rbtree_insert (&tree, e);
+    }
+  rb_cycles = rdtsc () - start;
+
+  start = rdtsc ();
+  for (i = 0; i < BENCH_OPS; i++)
+    {
+      struct pairing_heap_elem *e = pairing_heap_pop (&heap);
+      pairing_heap_entry (e, struct value, heap_elem)->value += i % 64;
+      pairing_heap_push (&heap, e);
+    }
+  heap_cycles = rdtsc () - start;
+
+  printf ("%d elements: list_insert_ordered %llu, rbtree %llu, "
+          "pairing_heap %llu cycles per requeue\n", size,
+          list_cycles / BENCH_OPS, rb_cycles / BENCH_OPS,
+          heap_cycles / BENCH_OPS);
+}
+
+/* Returns the element with the smallest value among those in the
+   heap. */
+static struct value *
+min_value (void)
+{
+  struct value *min = NULL;
+  int i;
+
+  for (i = 0; i < ELEM_CNT; i++)
+    if (values[i].in_heap && (min == NULL || values[i].value < min->value))
+      min = &values[i];
+  return min;
+}
+
+static bool
+heap_less (const struct pairing_heap_elem *a,
+           const struct pairing_heap_elem *b, void *aux UNUSED)
+{
+  return (pairing_heap_entry (a, struct value, heap_elem)->value
+          < pairing_heap_entry (b, struct value, heap_elem)->value);
+}
+
+static bool
+rb_less (const struct rb_elem *a, const struct rb_elem *b, void *aux UNUSED)
+{
+  return (rbtree_entry (a, struct value, rb_elem)->value
+          < rbtree_entry (b, struct value, rb_elem)->value);
+}
+
+static bool
+list_less (const struct list_elem *a, const struct list_elem *b,
+           void *aux UNUSED)
+{
+  return (list_entry (a, struct value, list_elem)->value
+          < list_entry (b, struct value, list_elem)->value);
+}
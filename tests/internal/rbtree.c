@@ -0,0 +1,238 @@
+/* Test program for lib/kernel/rbtree.c.
+
+   Inserts and removes random values, checking the red-black rules
+   and the in-order sequence after each step, then checks interval
+   queries against a brute-force scan.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <rbtree.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Maximum number of elements in a tree that we will test. */
+#define MAX_SIZE 256
+
+/* Number of random interval queries per tree. */
+#define QUERY_CNT 256
+
+/* Largest interval end point. */
+#define MAX_POINT 1024
+
+/* A tree element. */
+struct value
+  {
+    struct rb_elem elem;        /* Tree element. */
+    int value;                  /* Item value. */
+    int serial;                 /* Insertion order among equals. */
+  };
+
+/* An interval. */
+struct range
+  {
+    struct itree_elem elem;     /* Interval tree element. */
+    bool in_tree;               /* Currently inserted? */
+  };
+
+static void test_order (void);
+static void test_intervals (void);
+static bool value_less (const struct rb_elem *, const struct rb_elem *,
+                        void *);
+static int verify_subtree (struct rb_elem *, struct rb_elem *parent);
+static void verify_tree (struct rbtree *, size_t size);
+
+/* Test the red-black tree implementation. */
+void
+test (void)
+{
+  test_order ();
+  test_intervals ();
+  printf ("rbtree: PASS\n");
+}
+
+/* Fills trees of various sizes with random values, some of them
+   repeated, and checks structure and order as elements come and
+   go. */
+static void
+test_order (void)
+{
+  static struct value values[MAX_SIZE];
+  int size;
+
+  printf ("testing various size trees:");
+  for (size = 1; size <= MAX_SIZE; size *= 2)
+    {
+      struct rbtree tree;
+      struct rb_elem *e;
+      int i, serial = 0;
+
+      printf (" %d", size);
+      rbtree_init (&tree, value_less, NULL, NULL);
+      for (i = 0; i < size; i++)
+        {
+          values[i].value = random_ulong () % (size / 2 + 1);
+          values[i].serial = serial++;
+          rbtree_insert (&tree, &values[i].elem);
+          verify_tree (&tree, i + 1);
+        }
+
+      /* Every value present can be found, and finds the first
+         equal element. */
+      for (i = 0; i < size; i++)
+        {
+          e = rbtree_find (&tree, &values[i].elem);
+          ASSERT (e != NULL);
+          ASSERT (rbtree_entry (e, struct value, elem)->value
+                  == values[i].value);
+          ASSERT (rbtree_prev (e) == NULL
+                  || value_less (rbtree_prev (e), e, NULL));
+        }
+
+      /* Remove half the elements at random and reinsert them. */
+      for (i = 0; i < size; i++)
+        if (random_ulong () % 2)
+          {
+            rbtree_remove (&tree, &values[i].elem);
+            verify_tree (&tree, size - 1);
+            values[i].serial = serial++;
+            rbtree_insert (&tree, &values[i].elem);
+            verify_tree (&tree, size);
+          }
+
+      /* Drain in order. */
+      for (i = size; i > 0; i--)
+        {
+          struct value *v = rbtree_entry (rbtree_pop_min (&tree),
+                                          struct value, elem);
+          e = rbtree_min (&tree);
+          ASSERT (e == NULL || !value_less (e, &v->elem, NULL));
+          verify_tree (&tree, i - 1);
+        }
+      ASSERT (rbtree_empty (&tree));
+    }
+  printf (" done\n");
+}
+
+/* Checks itree_first() and itree_next() against a scan of all
+   the intervals, with intervals coming and going. */
+static void
+test_intervals (void)
+{
+  static struct range ranges[MAX_SIZE];
+  struct rbtree tree;
+  int i, q;
+
+  itree_init (&tree);
+  for (i = 0; i < MAX_SIZE; i++)
+    {
+      uint64_t start = random_ulong () % MAX_POINT;
+      uint64_t len = 1 + random_ulong () % (i % 4 == 0 ? MAX_POINT / 4 : 16);
+      ranges[i].elem.start = start;
+      ranges[i].elem.end = start + len;
+      ranges[i].in_tree = true;
+      itree_insert (&tree, &ranges[i].elem);
+    }
+
+  for (q = 0; q < QUERY_CNT; q++)
+    {
+      uint64_t start = random_ulong () % MAX_POINT;
+      uint64_t end = start + 1 + random_ulong () % 64;
+      struct itree_elem *it;
+      uint64_t last_start = 0;
+      int expected = 0, found = 0;
+
+      /* Toggle a random interval in or out of the tree. */
+      i = random_ulong () % MAX_SIZE;
+      if (ranges[i].in_tree)
+        itree_remove (&tree, &ranges[i].elem);
+      else
+        itree_insert (&tree, &ranges[i].elem);
+      ranges[i].in_tree = !ranges[i].in_tree;
+
+      for (i = 0; i < MAX_SIZE; i++)
+        if (ranges[i].in_tree
+            && ranges[i].elem.start < end && ranges[i].elem.end > start)
+          expected++;
+
+      for (it = itree_first (&tree, start, end); it != NULL;
+           it = itree_next (it, start, end))
+        {
+          struct range *r = itree_entry (it, struct range, elem);
+          ASSERT (r->in_tree);
+          ASSERT (it->start < end && it->end > start);
+          ASSERT (it->start >= last_start);
+          last_start = it->start;
+          found++;
+        }
+      ASSERT (found == expected);
+    }
+}
+
+/* Orders values by value alone.  SERIAL is left out so that
+   verify_tree() can check where rbtree_insert() puts equal
+   values. */
+static bool
+value_less (const struct rb_elem *a_, const struct rb_elem *b_,
+            void *aux UNUSED)
+{
+  const struct value *a = rbtree_entry (a_, struct value, elem);
+  const struct value *b = rbtree_entry (b_, struct value, elem);
+
+  return a->value < b->value;
+}
+
+/* Checks the links, coloring, and order of the subtree rooted at
+   E, whose parent should be PARENT, and returns its black
+   height. */
+static int
+verify_subtree (struct rb_elem *e, struct rb_elem *parent)
+{
+  int left, right;
+
+  if (e == NULL)
+    return 1;
+
+  ASSERT (e->parent == parent);
+  ASSERT (!e->red || ((e->left == NULL || !e->left->red)
+                       && (e->right == NULL || !e->right->red)));
+  ASSERT (e->left == NULL || !value_less (e, e->left, NULL));
+  ASSERT (e->right == NULL || !value_less (e->right, e, NULL));
+
+  left = verify_subtree (e->left, e);
+  right = verify_subtree (e->right, e);
+  ASSERT (left == right);
+  return left + !e->red;
+}
+
+/* Checks that TREE is a valid red-black tree of SIZE elements
+   and that equal values come out in insertion order. */
+static void
+verify_tree (struct rbtree *tree, size_t size)
+{
+  struct rb_elem *e, *prev = NULL;
+  size_t cnt = 0;
+
+  ASSERT (tree->root == NULL || !tree->root->red);
+  verify_subtree (tree->root, NULL);
+  ASSERT (rbtree_size (tree) == size);
+
+  for (e = rbtree_min (tree); e != NULL; prev = e, e = rbtree_next (e))
+    {
+      if (prev != NULL)
+        {
+          struct value *a = rbtree_entry (prev, struct value, elem);
+          struct value *b = rbtree_entry (e, struct value, elem);
+          ASSERT (a->value < b->value
+                  || (a->value == b->value && a->serial < b->serial));
+          ASSERT (rbtree_prev (e) == prev);
+        }
+      cnt++;
+    }
+  ASSERT (cnt == size);
+  ASSERT (prev == rbtree_max (tree));
+}
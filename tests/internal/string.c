@@ -0,0 +1,198 @@
+/* Test and microbenchmark for the block functions in
+   lib/string.c.
+
+   Checks memcpy(), memmove(), memset(), memcmp() and strlen()
+   against simple byte-at-a-time reference loops at every
+   alignment, then reports the throughput of each function in
+   bytes per CPU cycle for a range of block sizes.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/test.h"
+#include "intrinsic.h"
+
+/* Largest block that we will test or time. */
+#define MAX_SIZE 16384
+
+/* Number of timed calls per function and block size. */
+#define ITERATIONS 64
+
+static uint8_t buf_a[MAX_SIZE + 64];
+static uint8_t buf_b[MAX_SIZE + 64];
+static uint8_t ref[MAX_SIZE + 64];
+
+static void verify_functions (void);
+static void benchmark (const char *, size_t, uint64_t cycles);
+static uint64_t time_memcpy (size_t);
+static uint64_t time_memset (size_t);
+static uint64_t time_memcmp (size_t);
+static uint64_t time_strlen (size_t);
+
+/* Test and time the block functions. */
+void
+test (void) 
+{
+  static const size_t sizes[] = {16, 64, 256, 1024, 4096, MAX_SIZE};
+  size_t i;
+
+  verify_functions ();
+  printf ("string: correctness PASS\n");
+
+  printf ("%-8s %8s %12s\n", "function", "bytes", "bytes/cycle");
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++) 
+    {
+      benchmark ("memcpy", sizes[i], time_memcpy (sizes[i]));
+      benchmark ("memset", sizes[i], time_memset (sizes[i]));
+      benchmark ("memcmp", sizes[i], time_memcmp (sizes[i]));
+      benchmark ("strlen", sizes[i], time_strlen (sizes[i]));
+    }
+  printf ("string: PASS\n");
+}
+
+/* Fills BUF_A with random bytes and copies them to REF. */
+static void
+randomize (void) 
+{
+  size_t i;
+
+  random_bytes (buf_a, sizeof buf_a);
+  for (i = 0; i < sizeof buf_a; i++)
+    ref[i] = buf_a[i];
+}
+
+/* Checks that BUF_A matches REF. */
+static void
+verify_buf (void) 
+{
+  size_t i;
+
+  for (i = 0; i < sizeof buf_a; i++)
+    ASSERT (buf_a[i] == ref[i]);
+}
+
+/* Compares each function against a byte loop over a spread of
+   sizes and source and destination alignments. */
+static void
+verify_functions (void) 
+{
+  size_t size, i;
+  int dst_ofs, src_ofs;
+
+  for (size = 0; size <= 300; size = size < 20 ? size + 1 : size * 3 / 2)
+    for (dst_ofs = 0; dst_ofs < 16; dst_ofs++)
+      for (src_ofs = 0; src_ofs < 16; src_ofs++) 
+        {
+          /* memcpy(). */
+          randomize ();
+          random_bytes (buf_b, sizeof buf_b);
+          memcpy (buf_a + dst_ofs, buf_b + src_ofs, size);
+          for (i = 0; i < size; i++)
+            ref[dst_ofs + i] = buf_b[src_ofs + i];
+          verify_buf ();
+
+          /* memmove() in both directions within one buffer. */
+          randomize ();
+          memmove (buf_a + dst_ofs, buf_a + src_ofs, size);
+          if (dst_ofs < src_ofs)
+            for (i = 0; i < size; i++)
+              ref[dst_ofs + i] = ref[src_ofs + i];
+          else
+            for (i = size; i-- > 0; )
+              ref[dst_ofs + i] = ref[src_ofs + i];
+          verify_buf ();
+
+          /* memset(). */
+          randomize ();
+          memset (buf_a + dst_ofs, src_ofs * 17, size);
+          for (i = 0; i < size; i++)
+            ref[dst_ofs + i] = src_ofs * 17;
+          verify_buf ();
+
+          /* memcmp(), equal and with one differing byte. */
+          randomize ();
+          ASSERT (memcmp (buf_a + dst_ofs, ref + dst_ofs, size) == 0);
+          if (size > 0) 
+            {
+              size_t ofs = dst_ofs + random_ulong () % size;
+              ref[ofs]++;
+              ASSERT ((memcmp (buf_a + dst_ofs, ref + dst_ofs, size) < 0)
+                      == (buf_a[ofs] < ref[ofs]));
+            }
+
+          /* strlen(). */
+          randomize ();
+          for (i = 0; i < size; i++)
+            if (buf_a[dst_ofs + i] == '\0')
+              buf_a[dst_ofs + i] = 1;
+          buf_a[dst_ofs + size] = '\0';
+          ASSERT (strlen ((char *) buf_a + dst_ofs) == size);
+        }
+}
+
+/* Prints the throughput of function NAME on SIZE-byte blocks,
+   given that ITERATIONS calls took CYCLES cycles. */
+static void
+benchmark (const char *name, size_t size, uint64_t cycles) 
+{
+  uint64_t hundredths = cycles ? size * ITERATIONS * 100 / cycles : 0;
+
+  printf ("%-8s %8zu %9llu.%02llu\n", name, size,
+          hundredths / 100, hundredths % 100);
+}
+
+static uint64_t
+time_memcpy (size_t size) 
+{
+  uint64_t start = rdtsc ();
+  int i;
+
+  for (i = 0; i < ITERATIONS; i++)
+    memcpy (buf_a, buf_b, size);
+  return rdtsc () - start;
+}
+
+static uint64_t
+time_memset (size_t size) 
+{
+  uint64_t start = rdtsc ();
+  int i;
+
+  for (i = 0; i < ITERATIONS; i++)
+    memset (buf_a, i, size);
+  return rdtsc () - start;
+}
+
+static uint64_t
+time_memcmp (size_t size) 
+{
+  uint64_t start;
+  int i;
+
+  memcpy (buf_a, buf_b, size);
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    ASSERT (memcmp (buf_a, buf_b, size) == 0);
+  return rdtsc () - start;
+}
+
+static uint64_t
+time_strlen (size_t size) 
+{
+  uint64_t start;
+  int i;
+
+  memset (buf_a, 'x', size);
+  buf_a[size] = '\0';
+  start = rdtsc ();
+  for (i = 0; i < ITERATIONS; i++)
+    ASSERT (strlen ((char *) buf_a) == size);
+  return rdtsc () - start;
+}
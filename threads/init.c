@@ -21,6 +21,7 @@
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "intrinsic.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -31,6 +32,8 @@
 #include "tests/threads/tests.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/evict.h"
+#include "vm/zswap.h"
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
@@ -38,6 +41,12 @@
 #include "filesys/fsutil.h"
 #endif
 
+/* CR4 bit that enables global pages. */
+#define CR4_PGE 0x80
+
+/* CR0 bit that makes ring 0 honor read-only pages. */
+#define CR0_WP 0x10000
+
 /* Page-map-level-4 with kernel mappings only. */
 uint64_t *base_pml4;
 
@@ -60,6 +69,7 @@ static void run_actions (char **argv);
 static void usage (void);
 
 static void print_stats (void);
+static void print_meminfo (char **argv);
 
 
 int main (void) NO_RETURN;
@@ -103,6 +113,7 @@ main (void) {
 #endif
 	/* Start thread scheduler and enable interrupts. */
 	thread_start ();	// 스레드 스케줄러를 시작해서 스레드의 실행을 관리
+	palloc_zero_start ();
 	serial_init_queue ();
 	timer_calibrate ();
 
@@ -142,7 +153,15 @@ bss_init (void) {
 
 /* Populates the page table with the kernel virtual mapping,
  * and then sets up the CPU to use the new page directory.
- * Points base_pml4 to the pml4 it creates. */
+ * Points base_pml4 to the pml4 it creates.
+ *
+ * Physical memory is mapped with 2 MB large pages wherever a whole
+ * 2 MB region has the same permissions, which saves page-table
+ * memory and TLB entries.  The region holding the end of the
+ * read-only kernel text, and any partial region at the end of
+ * memory, fall back to 4 kB pages.  All of these mappings are
+ * global, so they survive the CR3 reloads done on every process
+ * switch. */
 static void
 paging_init (uint64_t mem_end) {
 	uint64_t *pml4, *pte;
@@ -150,21 +169,43 @@ paging_init (uint64_t mem_end) {
 	pml4 = base_pml4 = palloc_get_page (PAL_ASSERT | PAL_ZERO);
 
 	extern char start, _end_kernel_text;
+	uint64_t text_start = (uint64_t) &start;
+	uint64_t text_end = (uint64_t) &_end_kernel_text;
+
 	// Maps physical address [0 ~ mem_end] to
 	//   [LOADER_KERN_BASE ~ LOADER_KERN_BASE + mem_end].
-	for (uint64_t pa = 0; pa < mem_end; pa += PGSIZE) {
+	for (uint64_t pa = 0; pa < mem_end; ) {
 		uint64_t va = (uint64_t) ptov(pa);
-
-		perm = PTE_P | PTE_W;
-		if ((uint64_t) &start <= va && va < (uint64_t) &_end_kernel_text)
+		uint64_t large_end = va + LARGE_PGSIZE;
+
+		perm = PTE_P | PTE_W | PTE_G;
+		if (pa % LARGE_PGSIZE == 0 && pa + LARGE_PGSIZE <= mem_end
+				&& (large_end <= text_start || text_end <= va
+					|| (text_start <= va && large_end <= text_end))) {
+			if (text_start <= va && va < text_end)
+				perm &= ~PTE_W;
+
+			if ((pte = pml4e_walk_large (pml4, va, 1)) != NULL)
+				*pte = pa | perm | PTE_PS;
+			pa += LARGE_PGSIZE;
+			continue;
+		}
+
+		if (text_start <= va && va < text_end)
 			perm &= ~PTE_W;
 
 		if ((pte = pml4e_walk (pml4, va, 1)) != NULL)
 			*pte = pa | perm;
+		pa += PGSIZE;
 	}
 
-	// reload cr3
+	// enable global pages and reload cr3.  Also make the kernel honor
+	// read-only user mappings, so that its writes to a copy-on-write
+	// page fault like user writes do.
+	lcr0 (rcr0 () | CR0_WP);
+	lcr4 (rcr4 () | CR4_PGE);
 	pml4_activate(0);
+	pml4_pcid_init ();
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -221,11 +262,25 @@ parse_options (char **argv) {
 			random_init (atoi (value));
 		else if (!strcmp (name, "-mlfqs"))
 			thread_mlfqs = true;
+		else if (!strcmp (name, "-mtrace"))
+			malloc_trace = true;
 #ifdef USERPROG
 		else if (!strcmp (name, "-ul"))
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-evict")) {
+			if (value == NULL || !evict_select (value))
+				PANIC ("unknown eviction policy `%s'", value);
+		}
+		else if (!strcmp (name, "-zswap"))
+			zswap_max_pages = atoi (value);
+		else if (!strcmp (name, "-ksm"))
+			ksm_pages_to_scan = atoi (value);
+		else if (!strcmp (name, "-spt-time"))
+			spt_timing = true;
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -252,6 +307,16 @@ run_task (char **argv) {
 	printf ("Execution of '%s' complete.\n", task);
 }
 
+/* Prints where kernel memory is going. */
+static void
+print_meminfo (char **argv UNUSED) {
+	palloc_print_stats ();
+	malloc_print_stats ();
+#ifdef VM
+	vm_print_stats ();
+#endif
+}
+
 /* Executes all of the actions specified in ARGV[]
    up to the null pointer sentinel. */
 static void
@@ -266,6 +331,7 @@ run_actions (char **argv) {
 	/* Table of supported actions. */
 	static const struct action actions[] = {
 		{"run", 2, run_task},
+		{"meminfo", 1, print_meminfo},
 #ifdef FILESYS
 		{"ls", 1, fsutil_ls},
 		{"cat", 2, fsutil_cat},
@@ -312,6 +378,7 @@ usage (void) {
 #else
 			"  run TEST           Run TEST.\n"
 #endif
+			"  meminfo            Print kernel memory usage.\n"
 #ifdef FILESYS
 			"  ls                 List files in the root directory.\n"
 			"  cat FILE           Print FILE to the console.\n"
@@ -326,8 +393,15 @@ usage (void) {
 			"  -f                 Format file system disk during startup.\n"
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
+			"  -mtrace            Attribute kernel malloc() memory to callers.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -evict=POLICY      Evict user pages by POLICY: clock, 2q or arc.\n"
+			"  -zswap=PAGES       Keep up to PAGES of compressed swap in memory.\n"
+			"  -ksm=PAGES         Merge duplicate pages, scanning PAGES every 250 ms.\n"
+			"  -spt-time          Time supplemental page table lookups.\n"
 #endif
 			);
 	power_off ();
@@ -354,6 +428,12 @@ static void
 print_stats (void) {
 	timer_print_stats ();
 	thread_print_stats ();
+	palloc_print_stats ();
+	malloc_print_stats ();
+	pml4_print_stats ();
+#ifdef VM
+	vm_print_stats ();
+#endif
 #ifdef FILESYS
 	disk_print_stats ();
 #endif
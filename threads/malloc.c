@@ -11,35 +11,68 @@
 
 /* A simple implementation of malloc().
 
-   The size of each request, in bytes, is rounded up to a power
-   of 2 and assigned to the "descriptor" that manages blocks of
-   that size.  The descriptor keeps a list of free blocks.  If
-   the free list is nonempty, one of its blocks is used to
+   The size of each request, in bytes, is rounded up to one of a
+   fixed set of size classes and assigned to the "descriptor"
+   that manages blocks of that size.  Up to 1 kB the classes are
+   powers of 2; beyond that they alternate between 1.5x and
+   1.33x steps up to 12 kB so that a request just over a power
+   of 2 does not waste nearly half its block.  A step is only
+   kept if its blocks take fewer pages apiece than the big block
+   (below) they replace, which leaves 1.5 kB, 2 kB, 3 kB and
+   6 kB, and a request that a big block would hold in fewer
+   pages than its class skips the class.  The descriptor keeps a
+   list of free blocks.
+   If the free list is nonempty, one of its blocks is used to
    satisfy the request.
 
-   Otherwise, a new page of memory, called an "arena", is
-   obtained from the page allocator (if none is available,
-   malloc() returns a null pointer).  The new arena is divided
-   into blocks, all of which are added to the descriptor's free
-   list.  Then we return one of the new blocks.
+   Otherwise, a new run of pages, called an "arena", is obtained
+   from the page allocator (if none is available, malloc()
+   returns a null pointer).  Small classes use single-page
+   arenas; the larger classes use arenas of a few contiguous
+   pages, sized when the descriptor is created to keep the
+   unusable tail small.  The new arena is divided into blocks,
+   all of which are added to the descriptor's free list.  Then we
+   return one of the new blocks.
 
    When we free a block, we add it to its descriptor's free list.
    But if the arena that the block was in now has no in-use
    blocks, we remove all of the arena's blocks from the free list
    and give the arena back to the page allocator.
 
-   We can't handle blocks bigger than 2 kB using this scheme,
-   because they're too big to fit in a single page with a
-   descriptor.  We handle those by allocating contiguous pages
-   with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   A block in a single-page arena finds its arena by rounding its
+   address down to the page boundary.  That does not work for
+   blocks in multi-page arenas, so each of those is preceded by a
+   small header that points back to its arena.  The layout keeps
+   the two kinds apart by alignment: blocks in single-page arenas
+   (and big blocks, below) always start 8 bytes past a 16-byte
+   boundary, while blocks in multi-page arenas are 16-byte
+   aligned.
+
+   Requests bigger than the largest class are handled by
+   allocating contiguous pages with the page allocator and
+   sticking the allocation size at the beginning of the allocated
+   block's arena header.
+
+   realloc() resizes in place whenever it can: a block whose new
+   size still maps to the same descriptor is returned unchanged,
+   and a big block grows into the free pages that follow it or
+   gives its trailing pages back when it shrinks.
+
+   Each descriptor counts its arenas and in-use blocks for
+   malloc_print_stats().  With the -mtrace kernel option,
+   every block also carries a small header recording the caller
+   that allocated it and the size it asked for, so that the report
+   can attribute the memory still in use to call sites. */
 
 /* Descriptor. */
 struct desc {
 	size_t block_size;          /* Size of each element in bytes. */
 	size_t blocks_per_arena;    /* Number of blocks in an arena. */
+	size_t pages_per_arena;     /* Number of pages in an arena. */
 	struct list free_list;      /* List of free blocks. */
 	struct lock lock;           /* Lock. */
+	size_t arena_cnt;           /* Number of arenas. */
+	size_t used_cnt;            /* Number of blocks in use. */
 };
 
 /* Magic number for detecting arena corruption. */
@@ -57,10 +90,66 @@ struct block {
 	struct list_elem free_elem; /* Free list element. */
 };
 
+/* Header that precedes each block in a multi-page arena. */
+struct block_hdr {
+	struct arena *arena;        /* Arena that holds the block. */
+	unsigned magic;             /* Always set to ARENA_MAGIC. */
+};
+
+/* Alignment of blocks in multi-page arenas. */
+#define MULTI_ALIGN 16
+
+/* Offset of the first block header in a multi-page arena. */
+#define MULTI_FIRST_OFS ROUND_UP (sizeof (struct arena), MULTI_ALIGN)
+
+/* Largest block size served from a single-page arena. */
+#define SINGLE_MAX_SIZE (PGSIZE / 4)
+
+/* Largest number of pages in a multi-page arena. */
+#define ARENA_MAX_PAGES 8
+
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[16];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* -mtrace: Attribute blocks to their callers?  Must not change
+   once malloc_init() has run. */
+bool malloc_trace;
+
+/* Header that precedes each block when tracing. */
+struct trace_hdr {
+	void *caller;               /* Return address of the allocation. */
+	size_t size;                /* Requested size in bytes. */
+};
+
+/* Memory in use, per call site. */
+struct trace_site {
+	void *caller;               /* Return address, null if unused. */
+	size_t block_cnt;           /* Blocks in use. */
+	size_t byte_cnt;            /* Bytes requested by those blocks. */
+};
+
+/* Table of call sites, hashed by address. */
+#define TRACE_SITES 128
+static struct trace_site trace_sites[TRACE_SITES];
+static size_t trace_dropped;    /* Allocations from sites not in table. */
+
+/* Protects big-block counts and the call-site table. */
+static struct lock stats_lock;
+static size_t big_cnt;          /* Number of big blocks. */
+static size_t big_pages;        /* Pages in big blocks. */
+
+static struct desc *size_to_desc (size_t size);
+static void *block_alloc (size_t size);
+static void *block_realloc (void *, size_t size);
+static void block_free (void *);
+static void *traced_alloc (size_t size, void *caller);
+static void trace_account (void *caller, size_t size, bool alloc);
+static void *big_block_alloc (size_t size);
+static size_t multi_slot_size (const struct desc *);
+static size_t multi_pages_per_arena (size_t block_size);
+static bool multi_beats_big (const struct desc *, size_t page_cnt);
+static bool is_multi_block (const struct block *);
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
 
@@ -69,13 +158,39 @@ void
 malloc_init (void) {
 	size_t block_size;
 
-	for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2) {
+	ASSERT (sizeof (struct arena) % MULTI_ALIGN != 0);
+	ASSERT (sizeof (struct block_hdr) % MULTI_ALIGN == 0);
+	ASSERT (sizeof (struct trace_hdr) % MULTI_ALIGN == 0);
+
+	lock_init (&stats_lock);
+
+	for (block_size = 16; block_size <= SINGLE_MAX_SIZE; block_size *= 2) {
 		struct desc *d = &descs[desc_cnt++];
 		ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
 		d->block_size = block_size;
 		d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+		d->pages_per_arena = 1;
+		list_init (&d->free_list);
+		lock_init (&d->lock);
+	}
+
+	/* Intermediate classes: 1.5x and 1.33x steps up to 12 kB,
+	   leaving out those that cost more than big blocks. */
+	for (block_size = SINGLE_MAX_SIZE * 3 / 2;
+			block_size <= PGSIZE * 3;
+			block_size = block_size % 3 == 0
+				? block_size / 3 * 4 : block_size / 2 * 3) {
+		struct desc *d = &descs[desc_cnt];
+		ASSERT (desc_cnt < sizeof descs / sizeof *descs);
+		d->block_size = block_size;
+		d->pages_per_arena = multi_pages_per_arena (block_size);
+		d->blocks_per_arena = (d->pages_per_arena * PGSIZE - MULTI_FIRST_OFS)
+			/ multi_slot_size (d);
+		if (!multi_beats_big (d, DIV_ROUND_UP (block_size, PGSIZE)))
+			continue;
 		list_init (&d->free_list);
 		lock_init (&d->lock);
+		desc_cnt++;
 	}
 }
 
@@ -83,6 +198,158 @@ malloc_init (void) {
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) {
+	if (malloc_trace)
+		return traced_alloc (size, __builtin_return_address (0));
+	return block_alloc (size);
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b) {
+	void *p;
+	size_t size;
+
+	/* Calculate block size and make sure it fits in size_t. */
+	size = a * b;
+	if (size < a || size < b)
+		return NULL;
+
+	/* Allocate and zero memory. */
+	if (malloc_trace)
+		p = traced_alloc (size, __builtin_return_address (0));
+	else
+		p = block_alloc (size);
+	if (p != NULL)
+		memset (p, 0, size);
+
+	return p;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size) {
+	struct trace_hdr *h, *new_h;
+
+	if (!malloc_trace)
+		return block_realloc (old_block, new_size);
+
+	if (new_size == 0) {
+		free (old_block);
+		return NULL;
+	} else if (old_block == NULL)
+		return traced_alloc (new_size, __builtin_return_address (0));
+
+	h = (struct trace_hdr *) old_block - 1;
+	new_h = block_realloc (h, sizeof *h + new_size);
+	if (new_h == NULL)
+		return NULL;
+	trace_account (new_h->caller, new_h->size, false);
+	new_h->caller = __builtin_return_address (0);
+	new_h->size = new_size;
+	trace_account (new_h->caller, new_h->size, true);
+	return new_h + 1;
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p) {
+	if (p != NULL && malloc_trace) {
+		struct trace_hdr *h = (struct trace_hdr *) p - 1;
+		trace_account (h->caller, h->size, false);
+		p = h;
+	}
+	block_free (p);
+}
+
+/* Prints the number of arenas and in-use blocks of each size
+   class, the big blocks, and, with -mtrace, the call sites that
+   hold memory. */
+void
+malloc_print_stats (void) {
+	struct desc *d;
+	size_t i;
+
+	for (d = descs; d < descs + desc_cnt; d++)
+		if (d->arena_cnt > 0)
+			printf ("Malloc: %zu-byte blocks: %zu in use, %zu free, "
+					"%zu arenas of %zu pages\n",
+					d->block_size, d->used_cnt,
+					d->arena_cnt * d->blocks_per_arena - d->used_cnt,
+					d->arena_cnt, d->pages_per_arena);
+	printf ("Malloc: %zu big blocks, %zu pages\n", big_cnt, big_pages);
+
+	if (!malloc_trace)
+		return;
+	for (i = 0; i < TRACE_SITES; i++) {
+		struct trace_site *t = &trace_sites[i];
+		if (t->caller != NULL && t->block_cnt > 0)
+			printf ("Malloc: caller %p: %zu blocks, %zu bytes\n",
+					t->caller, t->block_cnt, t->byte_cnt);
+	}
+	if (trace_dropped > 0)
+		printf ("Malloc: %zu allocations from untracked callers\n",
+				trace_dropped);
+}
+
+/* Allocates a block of SIZE bytes with a trace header for
+   CALLER. */
+static void *
+traced_alloc (size_t size, void *caller) {
+	struct trace_hdr *h;
+
+	if (size == 0)
+		return NULL;
+	h = block_alloc (sizeof *h + size);
+	if (h == NULL)
+		return NULL;
+	h->caller = caller;
+	h->size = size;
+	trace_account (caller, size, true);
+	return h + 1;
+}
+
+/* Adds a SIZE-byte block allocated by CALLER to the call-site
+   table if ALLOC is true, or removes it if ALLOC is false. */
+static void
+trace_account (void *caller, size_t size, bool alloc) {
+	size_t i = ((uintptr_t) caller >> 2) % TRACE_SITES;
+	size_t probes;
+
+	lock_acquire (&stats_lock);
+	for (probes = 0; probes < TRACE_SITES; probes++) {
+		struct trace_site *t = &trace_sites[i];
+
+		if (t->caller == NULL && alloc)
+			t->caller = caller;
+		if (t->caller == caller) {
+			if (alloc) {
+				t->block_cnt++;
+				t->byte_cnt += size;
+			} else {
+				t->block_cnt--;
+				t->byte_cnt -= size;
+			}
+			break;
+		}
+		if (t->caller == NULL)
+			break;
+		i = (i + 1) % TRACE_SITES;
+	}
+	if (probes == TRACE_SITES && alloc)
+		trace_dropped++;
+	lock_release (&stats_lock);
+}
+
+/* Does the work of malloc() for an untraced block. */
+static void *
+block_alloc (size_t size) {
 	struct desc *d;
 	struct block *b;
 	struct arena *a;
@@ -93,24 +360,9 @@ malloc (size_t size) {
 
 	/* Find the smallest descriptor that satisfies a SIZE-byte
 	   request. */
-	for (d = descs; d < descs + desc_cnt; d++)
-		if (d->block_size >= size)
-			break;
-	if (d == descs + desc_cnt) {
-		/* SIZE is too big for any descriptor.
-		   Allocate enough pages to hold SIZE plus an arena. */
-		size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
-		a = palloc_get_multiple (0, page_cnt);
-		if (a == NULL)
-			return NULL;
-
-		/* Initialize the arena to indicate a big block of PAGE_CNT
-		   pages, and return it. */
-		a->magic = ARENA_MAGIC;
-		a->desc = NULL;
-		a->free_cnt = page_cnt;
-		return a + 1;
-	}
+	d = size_to_desc (size);
+	if (d == NULL)
+		return big_block_alloc (size);
 
 	lock_acquire (&d->lock);
 
@@ -118,19 +370,27 @@ malloc (size_t size) {
 	if (list_empty (&d->free_list)) {
 		size_t i;
 
-		/* Allocate a page. */
-		a = palloc_get_page (0);
+		/* Allocate the arena's pages.  If the pool is too
+		   fragmented to supply a whole multi-page arena, settle for
+		   a big block of just the pages this request needs. */
+		a = palloc_get_multiple (0, d->pages_per_arena);
 		if (a == NULL) {
 			lock_release (&d->lock);
-			return NULL;
+			return d->pages_per_arena > 1 ? big_block_alloc (size) : NULL;
 		}
 
 		/* Initialize arena and add its blocks to the free list. */
+		d->arena_cnt++;
 		a->magic = ARENA_MAGIC;
 		a->desc = d;
 		a->free_cnt = d->blocks_per_arena;
 		for (i = 0; i < d->blocks_per_arena; i++) {
 			struct block *b = arena_to_block (a, i);
+			if (d->pages_per_arena > 1) {
+				struct block_hdr *h = (struct block_hdr *) b - 1;
+				h->arena = a;
+				h->magic = ARENA_MAGIC;
+			}
 			list_push_back (&d->free_list, &b->free_elem);
 		}
 	}
@@ -139,30 +399,11 @@ malloc (size_t size) {
 	b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
 	a = block_to_arena (b);
 	a->free_cnt--;
+	d->used_cnt++;
 	lock_release (&d->lock);
 	return b;
 }
 
-/* Allocates and return A times B bytes initialized to zeroes.
-   Returns a null pointer if memory is not available. */
-void *
-calloc (size_t a, size_t b) {
-	void *p;
-	size_t size;
-
-	/* Calculate block size and make sure it fits in size_t. */
-	size = a * b;
-	if (size < a || size < b)
-		return NULL;
-
-	/* Allocate and zero memory. */
-	p = malloc (size);
-	if (p != NULL)
-		memset (p, 0, size);
-
-	return p;
-}
-
 /* Returns the number of bytes allocated for BLOCK. */
 static size_t
 block_size (void *block) {
@@ -173,33 +414,63 @@ block_size (void *block) {
 	return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
 
-/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
-   moving it in the process.
-   If successful, returns the new block; on failure, returns a
-   null pointer.
-   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
-   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
-void *
-realloc (void *old_block, size_t new_size) {
+/* Tries to resize the big block OLD_BLOCK to hold NEW_SIZE bytes
+   without moving it, by giving back its trailing pages or by
+   claiming the free pages right after it.  Returns true if
+   successful, false if the block must be moved. */
+static bool
+big_block_resize (void *old_block, size_t new_size) {
+	struct arena *a = block_to_arena (old_block);
+	size_t page_cnt = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+
+	ASSERT (a->desc == NULL);
+
+	if (page_cnt < a->free_cnt)
+		palloc_free_multiple ((uint8_t *) a + page_cnt * PGSIZE,
+				a->free_cnt - page_cnt);
+	else if (page_cnt > a->free_cnt
+			&& !palloc_extend_multiple (a, a->free_cnt, page_cnt))
+		return false;
+
+	lock_acquire (&stats_lock);
+	big_pages += page_cnt - a->free_cnt;
+	lock_release (&stats_lock);
+	a->free_cnt = page_cnt;
+	return true;
+}
+
+/* Does the work of realloc() for an untraced block. */
+static void *
+block_realloc (void *old_block, size_t new_size) {
 	if (new_size == 0) {
-		free (old_block);
+		block_free (old_block);
 		return NULL;
+	} else if (old_block == NULL) {
+		return block_alloc (new_size);
 	} else {
-		void *new_block = malloc (new_size);
-		if (old_block != NULL && new_block != NULL) {
+		/* Keep the block where it is if a fresh allocation of
+		   NEW_SIZE bytes would come from the same descriptor, or
+		   if both are big blocks and the pages around it allow. */
+		struct desc *old_desc = block_to_arena (old_block)->desc;
+		struct desc *new_desc = size_to_desc (new_size);
+		if (old_desc == new_desc
+				&& (new_desc != NULL || big_block_resize (old_block, new_size)))
+			return old_block;
+
+		void *new_block = block_alloc (new_size);
+		if (new_block != NULL) {
 			size_t old_size = block_size (old_block);
 			size_t min_size = new_size < old_size ? new_size : old_size;
 			memcpy (new_block, old_block, min_size);
-			free (old_block);
+			block_free (old_block);
 		}
 		return new_block;
 	}
 }
 
-/* Frees block P, which must have been previously allocated with
-   malloc(), calloc(), or realloc(). */
-void
-free (void *p) {
+/* Does the work of free() for an untraced block. */
+static void
+block_free (void *p) {
 	if (p != NULL) {
 		struct block *b = p;
 		struct arena *a = block_to_arena (b);
@@ -217,6 +488,7 @@ free (void *p) {
 
 			/* Add block to free list. */
 			list_push_front (&d->free_list, &b->free_elem);
+			d->used_cnt--;
 
 			/* If the arena is now entirely unused, free it. */
 			if (++a->free_cnt >= d->blocks_per_arena) {
@@ -227,22 +499,134 @@ free (void *p) {
 					struct block *b = arena_to_block (a, i);
 					list_remove (&b->free_elem);
 				}
-				palloc_free_page (a);
+				palloc_free_multiple (a, d->pages_per_arena);
+				d->arena_cnt--;
 			}
 
 			lock_release (&d->lock);
 		} else {
 			/* It's a big block.  Free its pages. */
+			lock_acquire (&stats_lock);
+			big_cnt--;
+			big_pages -= a->free_cnt;
+			lock_release (&stats_lock);
 			palloc_free_multiple (a, a->free_cnt);
 			return;
 		}
 	}
 }
-
+
+/* Returns the smallest descriptor whose blocks can hold SIZE
+   bytes, or a null pointer if SIZE needs a big block or fits in
+   a big block more cheaply. */
+static struct desc *
+size_to_desc (size_t size) {
+	size_t big_pages = DIV_ROUND_UP (size + sizeof (struct arena), PGSIZE);
+	struct desc *d;
+
+	for (d = descs; d < descs + desc_cnt; d++)
+		if (d->block_size >= size)
+			return (d->pages_per_arena == 1 || multi_beats_big (d, big_pages)
+					? d : NULL);
+	return NULL;
+}
+
+/* Allocates a big block of at least SIZE bytes directly from
+   the page allocator.  Returns a null pointer if memory is not
+   available. */
+static void *
+big_block_alloc (size_t size) {
+	/* Allocate enough pages to hold SIZE plus an arena. */
+	struct arena *a;
+	size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
+	a = palloc_get_multiple (0, page_cnt);
+	if (a == NULL)
+		return NULL;
+
+	/* Initialize the arena to indicate a big block of PAGE_CNT
+	   pages, and return it. */
+	a->magic = ARENA_MAGIC;
+	a->desc = NULL;
+	a->free_cnt = page_cnt;
+
+	lock_acquire (&stats_lock);
+	big_cnt++;
+	big_pages += page_cnt;
+	lock_release (&stats_lock);
+	return a + 1;
+}
+
+/* Returns the bytes taken by each block of multi-page arena
+   descriptor D, including its header. */
+static size_t
+multi_slot_size (const struct desc *d) {
+	return sizeof (struct block_hdr) + d->block_size;
+}
+
+/* Returns the number of pages, between 2 and ARENA_MAX_PAGES,
+   that makes the best use of a multi-page arena of BLOCK_SIZE-byte
+   blocks.  The first size that wastes no more than 1/16 of the
+   arena wins; failing that, the least wasteful one does. */
+static size_t
+multi_pages_per_arena (size_t block_size) {
+	size_t slot_size = sizeof (struct block_hdr) + block_size;
+	size_t best_pages = 0, best_waste = 0;
+	size_t page_cnt;
+
+	for (page_cnt = 2; page_cnt <= ARENA_MAX_PAGES; page_cnt++) {
+		size_t usable = page_cnt * PGSIZE - MULTI_FIRST_OFS;
+		size_t block_cnt = usable / slot_size;
+		size_t waste = usable - block_cnt * slot_size;
+
+		if (block_cnt < 2)
+			continue;
+		if (waste * 16 <= page_cnt * PGSIZE)
+			return page_cnt;
+		if (best_pages == 0
+				|| waste * best_pages < best_waste * page_cnt) {
+			best_pages = page_cnt;
+			best_waste = waste;
+		}
+	}
+	ASSERT (best_pages != 0);
+	return best_pages;
+}
+
+/* Returns true if a block of multi-page arena descriptor D takes
+   fewer pages, on average, than a big block of PAGE_CNT pages. */
+static bool
+multi_beats_big (const struct desc *d, size_t page_cnt) {
+	return d->pages_per_arena < d->blocks_per_arena * page_cnt;
+}
+
+/* Returns true if block B lives in a multi-page arena. */
+static bool
+is_multi_block (const struct block *b) {
+	return pg_ofs (b) % MULTI_ALIGN == 0;
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b) {
-	struct arena *a = pg_round_down (b);
+	struct arena *a;
+
+	if (is_multi_block (b)) {
+		struct block_hdr *h = (struct block_hdr *) b - 1;
+
+		/* Check that the header and arena are valid. */
+		ASSERT (h->magic == ARENA_MAGIC);
+		a = h->arena;
+		ASSERT (a != NULL);
+		ASSERT (a->magic == ARENA_MAGIC);
+		ASSERT (a->desc != NULL && a->desc->pages_per_arena > 1);
+
+		/* Check that the block is properly aligned for the arena. */
+		ASSERT (((uint8_t *) h - (uint8_t *) a - MULTI_FIRST_OFS)
+				% multi_slot_size (a->desc) == 0);
+		return a;
+	}
+
+	a = pg_round_down (b);
 
 	/* Check that the arena is valid. */
 	ASSERT (a != NULL);
@@ -262,6 +646,11 @@ arena_to_block (struct arena *a, size_t idx) {
 	ASSERT (a != NULL);
 	ASSERT (a->magic == ARENA_MAGIC);
 	ASSERT (idx < a->desc->blocks_per_arena);
+	if (a->desc->pages_per_arena > 1)
+		return (struct block *) ((uint8_t *) a
+				+ MULTI_FIRST_OFS
+				+ idx * multi_slot_size (a->desc)
+				+ sizeof (struct block_hdr));
 	return (struct block *) ((uint8_t *) a
 			+ sizeof *a
 			+ idx * a->desc->block_size);
@@ -1,21 +1,142 @@
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* Process-context identifiers.
+ *
+ * With CR4.PCIDE set, the CPU tags every TLB entry with the 12-bit
+ * PCID held in the low bits of CR3, and a CR3 load with bit 63 set
+ * keeps the cached translations of every PCID.  Each user pml4 gets
+ * its own PCID the first time it is activated, so switching between
+ * processes no longer empties the TLB.  The kernel-only base_pml4
+ * always runs as PCID 0.
+ *
+ * PCIDs are handed out in generations.  Once all of a generation's
+ * tags are used up, the whole TLB is flushed and numbering starts
+ * over; pml4s still holding a tag from an older generation get a
+ * fresh one on their next activation.  Entries left behind by dead
+ * address spaces therefore can never be reached again, without
+ * tracking which tags are still live.
+ *
+ * The tag lives in the last pml4 entry, which is never present
+ * (kernel space starts at index 1), so pml4_create() starts every
+ * pml4 with tag 0, "none assigned". */
+#define CR3_NOFLUSH (1ULL << 63)
+#define CR4_PGE 0x80
+#define CR4_PCIDE (1 << 17)
+#define CPUID_1_ECX_PCID (1 << 17)
+
+#define PCID_CNT 4096                           /* Number of PCIDs. */
+#define TAG_SLOT (PGSIZE / sizeof (uint64_t) - 1) /* pml4 entry holding tag. */
+#define TAG_PCID(TAG) (((TAG) >> 1) & (PCID_CNT - 1))
+#define TAG_STALE 0x2000                        /* Flush on next load. */
+#define TAG_GEN_SHIFT 16                        /* Generation in bits 16+. */
+
+static bool pcid_enabled;
+static uint64_t pcid_generation = 1;
+static uint64_t pcid_next = 1;
+
+/* Statistics. */
+static size_t pcid_kept;        /* # of CR3 loads that kept the TLB. */
+static size_t pcid_flushed;     /* # of CR3 loads that flushed one PCID. */
+static size_t pcid_rollovers;   /* # of whole-TLB flushes for new tags. */
+
+/* The page table most recently found by pt_lookup(), which maps
+ * the 2 MB region of user space starting at VA in PML4.  Page
+ * tables are only freed by pml4_destroy(), which drops the cache.
+ * Accessed only with interrupts off. */
+static struct {
+	uint64_t *pml4;
+	uint64_t va;
+	uint64_t *pt;
+} pt_cache;
+
+/* Range updates that change more than this many present pages are
+ * flushed with one CR3 reload instead of one invlpg per page. */
+#define TLB_BATCH_MAX 32
+
+/* Pending TLB invalidations for a range update of PML4. */
+struct tlb_batch {
+	uint64_t *pml4;
+	bool active;                    /* Is PML4 loaded in CR3? */
+	size_t cnt;                     /* Number of pages changed. */
+	uint64_t va[TLB_BATCH_MAX];     /* First TLB_BATCH_MAX of them. */
+};
+
+static size_t tlb_invlpgs;      /* # of pages flushed with invlpg. */
+static size_t tlb_reloads;      /* # of range flushes done by CR3 reload. */
+
+/* Page-table pages freed by pml4_destroy(), kept zeroed so that
+ * new page tables can be handed out without going to palloc or
+ * clearing a page.  The pages are linked through their first word,
+ * which is cleared again when a page is taken.  Accessed only with
+ * interrupts off. */
+#define PTP_CACHE_MAX 64
+static uint64_t *ptp_free_list;
+static size_t ptp_cache_cnt;
+
+static size_t ptp_reused;       /* # of page tables taken from the cache. */
+static size_t ptp_fresh;        /* # of page tables from palloc. */
+static size_t ptp_released;     /* # of page tables freed, cache full. */
+
+/* Returns a zeroed page for use as a page table, or a null
+ * pointer if memory is exhausted. */
+static uint64_t *
+ptp_alloc (void) {
+	enum intr_level old_level = intr_disable ();
+	uint64_t *page = ptp_free_list;
+	if (page != NULL) {
+		ptp_free_list = (uint64_t *) page[0];
+		ptp_cache_cnt--;
+		ptp_reused++;
+	} else
+		ptp_fresh++;
+	intr_set_level (old_level);
+
+	if (page == NULL)
+		return palloc_get_page (PAL_ZERO);
+	page[0] = 0;
+	return page;
+}
+
+/* Frees page table PAGE, which must be all zeros, keeping it in the
+ * cache if there is room. */
+static void
+ptp_free (void *page_) {
+	uint64_t *page = page_;
+	enum intr_level old_level = intr_disable ();
+	if (ptp_cache_cnt < PTP_CACHE_MAX) {
+		page[0] = (uint64_t) ptp_free_list;
+		ptp_free_list = page;
+		ptp_cache_cnt++;
+		page = NULL;
+	} else
+		ptp_released++;
+	intr_set_level (old_level);
+
+	if (page != NULL)
+		palloc_free_page (page);
+}
+
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
 	if (pdp) {
 		uint64_t *pte = (uint64_t *) pdp[idx];
+		/* A large page has no page table; its PDE is the leaf. */
+		if ((uint64_t) pte & PTE_P && (uint64_t) pte & PTE_PS)
+			return &pdp[idx];
 		if (!((uint64_t) pte & PTE_P)) {
 			if (create) {
-				uint64_t *new_page = palloc_get_page (PAL_ZERO);
+				uint64_t *new_page = ptp_alloc ();
 				if (new_page)
 					pdp[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
 				else
@@ -37,7 +158,7 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
 		uint64_t *pde = (uint64_t *) pdpe[idx];
 		if (!((uint64_t) pde & PTE_P)) {
 			if (create) {
-				uint64_t *new_page = palloc_get_page (PAL_ZERO);
+				uint64_t *new_page = ptp_alloc ();
 				if (new_page) {
 					pdpe[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
 					allocated = 1;
@@ -49,7 +170,7 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
 		pte = pgdir_walk (ptov (PTE_ADDR (pdpe[idx])), va, create);
 	}
 	if (pte == NULL && allocated) {
-		palloc_free_page ((void *) ptov (PTE_ADDR (pdpe[idx])));
+		ptp_free ((void *) ptov (PTE_ADDR (pdpe[idx])));
 		pdpe[idx] = 0;
 	}
 	return pte;
@@ -70,7 +191,7 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 		uint64_t *pdpe = (uint64_t *) pml4e[idx];
 		if (!((uint64_t) pdpe & PTE_P)) {
 			if (create) {
-				uint64_t *new_page = palloc_get_page (PAL_ZERO);
+				uint64_t *new_page = ptp_alloc ();
 				if (new_page) {
 					pml4e[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
 					allocated = 1;
@@ -82,19 +203,56 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 		pte = pdpe_walk (ptov (PTE_ADDR (pml4e[idx])), va, create);
 	}
 	if (pte == NULL && allocated) {
-		palloc_free_page ((void *) ptov (PTE_ADDR (pml4e[idx])));
+		ptp_free ((void *) ptov (PTE_ADDR (pml4e[idx])));
 		pml4e[idx] = 0;
 	}
 	return pte;
 }
 
+/* Returns the next-level table that entry IDX of directory DIR
+ * points to.  If the entry is not present, behavior depends on
+ * CREATE: if true, a zeroed table is allocated and installed,
+ * otherwise (or if allocation fails) a null pointer is returned. */
+static uint64_t *
+dir_next_level (uint64_t *dir, int idx, int create) {
+	if (!(dir[idx] & PTE_P)) {
+		uint64_t *new_page = create ? ptp_alloc () : NULL;
+		if (new_page == NULL)
+			return NULL;
+		dir[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+	}
+	return ptov (PTE_ADDR (dir[idx]));
+}
+
+/* Returns the address of the page directory entry for virtual
+ * address VA in page map level 4, pml4, for mapping VA with a 2 MB
+ * large page.  Missing upper levels are handled according to
+ * CREATE, as in pml4e_walk().  Returns a null pointer if VA is
+ * already covered by a page table of 4 kB pages. */
+uint64_t *
+pml4e_walk_large (uint64_t *pml4e, const uint64_t va, int create) {
+	uint64_t *pdpe, *pgdir, *pde;
+
+	pdpe = dir_next_level (pml4e, PML4 (va), create);
+	if (pdpe == NULL)
+		return NULL;
+	pgdir = dir_next_level (pdpe, PDPE (va), create);
+	if (pgdir == NULL)
+		return NULL;
+
+	pde = &pgdir[PDX (va)];
+	if ((*pde & PTE_P) && !(*pde & PTE_PS))
+		return NULL;
+	return pde;
+}
+
 /* Creates a new page map level 4 (pml4) has mappings for kernel
  * virtual addresses, but none for user virtual addresses.
  * Returns the new page directory, or a null pointer if memory
  * allocation fails. */
 uint64_t *
 pml4_create (void) {
-	uint64_t *pml4 = palloc_get_page (0);
+	uint64_t *pml4 = ptp_alloc ();
 	if (pml4)
 		memcpy (pml4, base_pml4, PGSIZE);
 	return pml4;
@@ -122,10 +280,18 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
+		if (((uint64_t) pte) & PTE_P) {
+			if (((uint64_t) pte) & PTE_PS) {
+				/* A large page: hand FUNC the PDE itself. */
+				void *va = (void *) (((uint64_t) pml4_index << PML4SHIFT) |
+									 ((uint64_t) pdp_index << PDPESHIFT) |
+									 ((uint64_t) i << PDXSHIFT));
+				if (!func (&pdp[i], va, aux))
+					return false;
+			} else if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
 					pml4_index, pdp_index, i))
 				return false;
+		}
 	}
 	return true;
 }
@@ -155,24 +321,32 @@ pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
 	return true;
 }
 
+/* Page tables are torn down entry by entry anyway, so each destroy
+ * function clears the entries it visits and hands the then-zeroed
+ * page back to the page-table cache. */
+
 static void
 pt_destroy (uint64_t *pt) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pt[i]);
 		if (((uint64_t) pte) & PTE_P)
 			palloc_free_page ((void *) PTE_ADDR (pte));
+		if (pt[i] != 0)
+			pt[i] = 0;
 	}
-	palloc_free_page ((void *) pt);
+	ptp_free ((void *) pt);
 }
 
 static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if (((uint64_t) pte) & PTE_P && !(((uint64_t) pte) & PTE_PS))
 			pt_destroy (PTE_ADDR (pte));
+		if (pdp[i] != 0)
+			pdp[i] = 0;
 	}
-	palloc_free_page ((void *) pdp);
+	ptp_free ((void *) pdp);
 }
 
 static void
@@ -181,8 +355,10 @@ pdpe_destroy (uint64_t *pdpe) {
 		uint64_t *pde = ptov((uint64_t *) pdpe[i]);
 		if (((uint64_t) pde) & PTE_P)
 			pgdir_destroy ((void *) PTE_ADDR (pde));
+		if (pdpe[i] != 0)
+			pdpe[i] = 0;
 	}
-	palloc_free_page ((void *) pdpe);
+	ptp_free ((void *) pdpe);
 }
 
 /* Destroys pml4e, freeing all the pages it references. */
@@ -192,18 +368,289 @@ pml4_destroy (uint64_t *pml4) {
 		return;
 	ASSERT (pml4 != base_pml4);
 
+	enum intr_level old_level = intr_disable ();
+	if (pt_cache.pml4 == pml4)
+		pt_cache.pml4 = NULL;
+	intr_set_level (old_level);
+
 	/* if PML4 (vaddr) >= 1, it's kernel space by define. */
 	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
 	if (((uint64_t) pdpe) & PTE_P)
 		pdpe_destroy ((void *) PTE_ADDR (pdpe));
-	palloc_free_page ((void *) pml4);
+
+	/* Clear the kernel entries copied from base_pml4 and the PCID
+	 * tag. */
+	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+		if (pml4[i] != 0)
+			pml4[i] = 0;
+	ptp_free ((void *) pml4);
+}
+
+/* Turns on PCIDs if the CPU has them.  Must be called while
+ * base_pml4 is loaded, since CR4.PCIDE can only be set while the
+ * PCID field of CR3 is 0. */
+void
+pml4_pcid_init (void) {
+	uint32_t eax = 1, ebx, ecx = 0, edx;
+
+	asm ("cpuid" : "+a" (eax), "=b" (ebx), "+c" (ecx), "=d" (edx));
+	if (!(ecx & CPUID_1_ECX_PCID))
+		return;
+
+	ASSERT (rcr3 () == vtop (base_pml4));
+	lcr4 (rcr4 () | CR4_PCIDE);
+	pcid_enabled = true;
+}
+
+/* Returns the CR3 value that loads PML4 under its own PCID,
+ * assigning a new PCID first if PML4 has none in the current
+ * generation.  The no-flush bit is set unless PML4's translations
+ * may be stale.  Interrupts must be off. */
+static uint64_t
+pcid_cr3 (uint64_t *pml4) {
+	uint64_t tag = pml4[TAG_SLOT];
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (tag >> TAG_GEN_SHIFT != pcid_generation) {
+		if (pcid_next == PCID_CNT) {
+			/* Out of tags.  With PCIDs enabled, changing CR4.PGE
+			 * flushes the TLB entries of every PCID. */
+			uint64_t cr4 = rcr4 ();
+			lcr4 (cr4 & ~CR4_PGE);
+			lcr4 (cr4);
+			pcid_generation++;
+			pcid_next = 1;
+			pcid_rollovers++;
+		}
+		tag = pcid_generation << TAG_GEN_SHIFT | pcid_next++ << 1 | TAG_STALE;
+	}
+
+	if (tag & TAG_STALE) {
+		pml4[TAG_SLOT] = tag & ~TAG_STALE;
+		pcid_flushed++;
+		return vtop (pml4) | TAG_PCID (tag);
+	}
+	pml4[TAG_SLOT] = tag;
+	pcid_kept++;
+	return vtop (pml4) | TAG_PCID (tag) | CR3_NOFLUSH;
 }
 
 /* Loads page directory PD into the CPU's page directory base
- * register. */
+ * register.  With PCIDs, the TLB entries of other address spaces
+ * are kept. */
 void
 pml4_activate (uint64_t *pml4) {
-	lcr3 (vtop (pml4 ? pml4 : base_pml4));
+	if (!pcid_enabled) {
+		lcr3 (vtop (pml4 ? pml4 : base_pml4));
+		return;
+	}
+
+	enum intr_level old_level = intr_disable ();
+	if (pml4 == NULL || pml4 == base_pml4)
+		lcr3 (vtop (base_pml4) | CR3_NOFLUSH);
+	else
+		lcr3 (pcid_cr3 (pml4));
+	intr_set_level (old_level);
+}
+
+/* Makes PML4's next activation flush the translations cached
+ * under its PCID.  Does nothing if PML4 has never been loaded with
+ * a PCID, since then none can be cached. */
+static void
+pcid_mark_stale (uint64_t *pml4) {
+	enum intr_level old_level = intr_disable ();
+	if (pml4[TAG_SLOT] != 0)
+		pml4[TAG_SLOT] |= TAG_STALE;
+	intr_set_level (old_level);
+}
+
+/* Stores VAL into PTE, the entry for user virtual page VA in PML4,
+ * and drops any translation for VA that the TLB may hold.  If PML4
+ * is not the active page table, its PCID is marked stale instead,
+ * so that it is flushed when PML4 is next activated.  Interrupts
+ * stay off throughout, so that PML4 cannot be loaded in between
+ * with the old translation still cached under its PCID. */
+static void
+pte_store (uint64_t *pml4, uint64_t *pte, const void *va, uint64_t val) {
+	enum intr_level old_level = intr_disable ();
+	bool was_present = *pte & PTE_P;
+
+	*pte = val;
+	if (was_present) {
+		if (PTE_ADDR (rcr3 ()) == vtop (pml4))
+			invlpg ((uint64_t) va);
+		else
+			pcid_mark_stale (pml4);
+	}
+	intr_set_level (old_level);
+}
+
+/* Returns the page table that maps the 2 MB region of user space
+ * holding VA in PML4.  If there is none, creates it if CREATE is
+ * true, otherwise returns a null pointer.  The result is cached,
+ * so runs of calls for neighbouring pages skip the four-level
+ * walk. */
+static uint64_t *
+pt_lookup (uint64_t *pml4, uint64_t va, bool create) {
+	uint64_t region = va & ~LARGE_PGMASK;
+	uint64_t *pt = NULL;
+	enum intr_level old_level;
+
+	ASSERT (is_user_vaddr (va));
+
+	old_level = intr_disable ();
+	if (pt_cache.pml4 == pml4 && pt_cache.va == region)
+		pt = pt_cache.pt;
+	intr_set_level (old_level);
+	if (pt != NULL)
+		return pt;
+
+	/* The entry for the first page of the region is the start of
+	 * its page table. */
+	pt = pml4e_walk (pml4, region, create);
+	if (pt != NULL) {
+		old_level = intr_disable ();
+		pt_cache.pml4 = pml4;
+		pt_cache.va = region;
+		pt_cache.pt = pt;
+		intr_set_level (old_level);
+	}
+	return pt;
+}
+
+/* Returns the address of the page table entry for VA in PML4,
+ * like pml4e_walk(), using the page table cache for user
+ * addresses. */
+static uint64_t *
+pte_lookup (uint64_t *pml4, const void *va, bool create) {
+	if (is_user_vaddr (va)) {
+		uint64_t *pt = pt_lookup (pml4, (uint64_t) va, create);
+		return pt != NULL ? &pt[PTX (va)] : NULL;
+	}
+	return pml4e_walk (pml4, (uint64_t) va, create);
+}
+
+/* Starts batching the TLB invalidations of a range update of
+ * PML4.  An inactive PML4 is marked stale up front as well as at
+ * the end, so that an activation in the middle of the update cannot
+ * keep using translations cached before it started. */
+static void
+tlb_batch_init (struct tlb_batch *b, uint64_t *pml4) {
+	b->pml4 = pml4;
+	b->active = PTE_ADDR (rcr3 ()) == vtop (pml4);
+	b->cnt = 0;
+	if (!b->active)
+		pcid_mark_stale (pml4);
+}
+
+/* Records that the present mapping for VA changed. */
+static void
+tlb_batch_add (struct tlb_batch *b, uint64_t va) {
+	if (b->cnt < TLB_BATCH_MAX)
+		b->va[b->cnt] = va;
+	b->cnt++;
+}
+
+/* Issues the invalidations recorded in B. */
+static void
+tlb_batch_flush (struct tlb_batch *b) {
+	if (b->cnt == 0)
+		return;
+
+	if (!b->active)
+		pcid_mark_stale (b->pml4);
+	else if (b->cnt <= TLB_BATCH_MAX) {
+		for (size_t i = 0; i < b->cnt; i++)
+			invlpg (b->va[i]);
+		tlb_invlpgs += b->cnt;
+	} else {
+		pcid_mark_stale (b->pml4);
+		pml4_activate (b->pml4);
+		tlb_reloads++;
+	}
+}
+
+/* Computes the new value of page table entry PTE, which maps VA,
+ * for a range update. */
+typedef uint64_t pte_update_func (uint64_t pte, uint64_t va, void *aux);
+
+/* Applies UPDATE to the entries for the CNT user pages starting
+ * at VA in PML4, walking once per page table rather than once per
+ * page, and flushes the TLB once at the end.  Regions without a
+ * page table are skipped. */
+static void
+range_update (uint64_t *pml4, uint64_t va, size_t cnt,
+		pte_update_func *update, void *aux) {
+	struct tlb_batch b;
+
+	ASSERT (pg_ofs (va) == 0);
+	ASSERT (cnt == 0 || is_user_vaddr (va + cnt * PGSIZE - 1));
+
+	tlb_batch_init (&b, pml4);
+	while (cnt > 0) {
+		size_t run = (LARGE_PGSIZE - (va & LARGE_PGMASK)) / PGSIZE;
+		uint64_t *pt = pt_lookup (pml4, va, false);
+
+		if (run > cnt)
+			run = cnt;
+		for (size_t i = PTX (va); pt != NULL && i < PTX (va) + run; i++) {
+			uint64_t page = (va & ~LARGE_PGMASK) | (uint64_t) i << PTXSHIFT;
+			uint64_t old = pt[i];
+			uint64_t new = update (old, page, aux);
+
+			if (new != old) {
+				pt[i] = new;
+				if (old & PTE_P)
+					tlb_batch_add (&b, page);
+			}
+		}
+		va += run * PGSIZE;
+		cnt -= run;
+	}
+	tlb_batch_flush (&b);
+}
+
+static uint64_t
+unmap_range_update (uint64_t pte, uint64_t va UNUSED, void *aux UNUSED) {
+	return pte & ~PTE_P;
+}
+
+static uint64_t
+protect_range_update (uint64_t pte, uint64_t va UNUSED, void *rw) {
+	if (!(pte & PTE_P))
+		return pte;
+	return *(bool *) rw ? pte | PTE_W : pte & ~PTE_W;
+}
+
+/* Marks the PAGE_CNT user virtual pages starting at UPAGE "not
+ * present" in PML4, like pml4_clear_page() on each of them.  The
+ * pages need not be mapped. */
+void
+pml4_unmap_range (uint64_t *pml4, void *upage, size_t page_cnt) {
+	range_update (pml4, (uint64_t) upage, page_cnt, unmap_range_update,
+			NULL);
+}
+
+/* Makes the mapped pages among the PAGE_CNT user virtual pages
+ * starting at UPAGE in PML4 writable if RW is true, read-only
+ * otherwise. */
+void
+pml4_protect_range (uint64_t *pml4, void *upage, size_t page_cnt, bool rw) {
+	range_update (pml4, (uint64_t) upage, page_cnt, protect_range_update,
+			&rw);
+}
+
+/* Prints PCID, TLB flush and page-table cache statistics. */
+void
+pml4_print_stats (void) {
+	if (pcid_enabled)
+		printf ("PCID: %zu switches kept the TLB, %zu flushed, "
+				"%zu rollovers\n", pcid_kept, pcid_flushed, pcid_rollovers);
+	printf ("TLB: %zu range invlpgs, %zu range reloads\n",
+			tlb_invlpgs, tlb_reloads);
+	printf ("Page tables: %zu reused, %zu fresh, %zu released\n",
+			ptp_reused, ptp_fresh, ptp_released);
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -214,10 +661,13 @@ void *
 pml4_get_page (uint64_t *pml4, const void *uaddr) {
 	ASSERT (is_user_vaddr (uaddr));
 
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
+	uint64_t *pte = pte_lookup (pml4, uaddr, false);
 
-	if (pte && (*pte & PTE_P))
+	if (pte && (*pte & PTE_P)) {
+		if (*pte & PTE_PS)
+			return ptov (PTE_ADDR (*pte)) + ((uint64_t) uaddr & LARGE_PGMASK);
 		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
+	}
 	return NULL;
 }
 
@@ -236,10 +686,11 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 	ASSERT (is_user_vaddr (upage));
 	ASSERT (pml4 != base_pml4);
 
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) upage, 1);
+	uint64_t *pte = pte_lookup (pml4, upage, true);
 
 	if (pte)
-		*pte = vtop (kpage) | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+		pte_store (pml4, pte, upage,
+				vtop (kpage) | PTE_P | (rw ? PTE_W : 0) | PTE_U);
 	return pte != NULL;
 }
 
@@ -253,13 +704,10 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (is_user_vaddr (upage));
 
-	pte = pml4e_walk (pml4, (uint64_t) upage, false);
+	pte = pte_lookup (pml4, upage, false);
 
-	if (pte != NULL && (*pte & PTE_P) != 0) {
-		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
-	}
+	if (pte != NULL && (*pte & PTE_P) != 0)
+		pte_store (pml4, pte, upage, *pte & ~PTE_P);
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PML4 is dirty,
@@ -268,7 +716,7 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
  * Returns false if PML4 contains no PTE for VPAGE. */
 bool
 pml4_is_dirty (uint64_t *pml4, const void *vpage) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	uint64_t *pte = pte_lookup (pml4, vpage, false);
 	return pte != NULL && (*pte & PTE_D) != 0;
 }
 
@@ -276,16 +724,10 @@ pml4_is_dirty (uint64_t *pml4, const void *vpage) {
  * in PML4. */
 void
 pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
-	if (pte) {
-		if (dirty)
-			*pte |= PTE_D;
-		else
-			*pte &= ~(uint32_t) PTE_D;
-
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
-	}
+	uint64_t *pte = pte_lookup (pml4, vpage, false);
+	if (pte)
+		pte_store (pml4, pte, vpage,
+				dirty ? *pte | PTE_D : *pte & ~(uint64_t) PTE_D);
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PML4 has been
@@ -294,7 +736,7 @@ pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
  * PML4 contains no PTE for VPAGE. */
 bool
 pml4_is_accessed (uint64_t *pml4, const void *vpage) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	uint64_t *pte = pte_lookup (pml4, vpage, false);
 	return pte != NULL && (*pte & PTE_A) != 0;
 }
 
@@ -302,14 +744,8 @@ pml4_is_accessed (uint64_t *pml4, const void *vpage) {
    VPAGE in PD. */
 void
 pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
-	if (pte) {
-		if (accessed)
-			*pte |= PTE_A;
-		else
-			*pte &= ~(uint32_t) PTE_A;
-
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
-	}
+	uint64_t *pte = pte_lookup (pml4, vpage, false);
+	if (pte)
+		pte_store (pml4, pte, vpage,
+				accessed ? *pte | PTE_A : *pte & ~(uint64_t) PTE_A);
 }
@@ -9,7 +9,9 @@
 #include <string.h>
 #include "threads/init.h"
 #include "threads/loader.h"
+#include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -24,13 +26,32 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool also keeps a small stack of free pages that have
+   already been filled with zeros.  A low-priority "pagezero"
+   thread refills it whenever nothing else wants the CPU, so that
+   single-page PAL_ZERO requests, which cover thread stacks, page
+   tables and fresh user pages, can skip the memset.  Pages on the
+   stack are marked used in the bitmap; if an allocation cannot
+   otherwise be satisfied, the stack is handed back first. */
+
+/* Number of pre-zeroed pages each pool keeps on hand. */
+#define ZEROED_MAX 64
+
+/* Refill the pre-zeroed stack once it drops below this. */
+#define ZEROED_LOW (ZEROED_MAX / 2)
 
 /* A memory pool. */
 struct pool {
 	struct lock lock;               /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
+
+	void *zeroed[ZEROED_MAX];       /* Stack of pre-zeroed free pages. */
+	size_t zeroed_cnt;              /* Number of pages on the stack. */
+	size_t zero_hits;               /* PAL_ZERO pages taken from the stack. */
+	size_t zero_misses;             /* PAL_ZERO pages zeroed on demand. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -42,6 +63,17 @@ static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static void *zeroed_pop (struct pool *);
+static void zeroed_release (struct pool *);
+static void zeroer_wake (void);
+static void zeroer (void *aux);
+
+/* Wakes the pagezero thread when the pools run low. */
+static struct semaphore zeroer_sema;
+
+/* True while the pagezero thread waits on ZEROER_SEMA.
+   Accessed with interrupts off. */
+static bool zeroer_sleeping;
 
 /* multiboot info */
 struct multiboot_info {
@@ -262,11 +294,26 @@ palloc_init (void) {
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	void *pages;
+
+	/* A single zeroed page comes off the pre-zeroed stack if it
+	   can. */
+	if ((flags & PAL_ZERO) && page_cnt == 1) {
+		pages = zeroed_pop (pool);
+		if (pages != NULL)
+			return pages;
+	}
 
 	lock_acquire (&pool->lock);
 	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+	if (page_idx == BITMAP_ERROR && pool->zeroed_cnt > 0) {
+		/* Give the pre-zeroed pages back and try again. */
+		zeroed_release (pool);
+		page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+	}
+	if (page_idx != BITMAP_ERROR && (flags & PAL_ZERO))
+		pool->zero_misses += page_cnt;
 	lock_release (&pool->lock);
-	void *pages;
 
 	if (page_idx != BITMAP_ERROR)
 		pages = pool->base + PGSIZE * page_idx;
@@ -296,6 +343,41 @@ palloc_get_page (enum palloc_flags flags) {
 	return palloc_get_multiple (flags, 1);
 }
 
+/* Tries to grow the PAGE_CNT-page block at PAGES, obtained from
+   palloc_get_multiple(), to NEW_PAGE_CNT pages in place by
+   claiming the pages that immediately follow it.  Returns true if
+   successful, false if any of those pages is in use or lies
+   outside the block's pool. */
+bool
+palloc_extend_multiple (void *pages, size_t page_cnt, size_t new_page_cnt) {
+	struct pool *pool;
+	size_t page_idx;
+	bool success = false;
+
+	ASSERT (pg_ofs (pages) == 0);
+	ASSERT (new_page_cnt >= page_cnt);
+
+	if (page_from_pool (&kernel_pool, pages))
+		pool = &kernel_pool;
+	else if (page_from_pool (&user_pool, pages))
+		pool = &user_pool;
+	else
+		NOT_REACHED ();
+
+	page_idx = pg_no (pages) - pg_no (pool->base) + page_cnt;
+	if (page_idx + (new_page_cnt - page_cnt) > bitmap_size (pool->used_map))
+		return false;
+
+	lock_acquire (&pool->lock);
+	if (bitmap_none (pool->used_map, page_idx, new_page_cnt - page_cnt)) {
+		bitmap_set_multiple (pool->used_map, page_idx,
+				new_page_cnt - page_cnt, true);
+		success = true;
+	}
+	lock_release (&pool->lock);
+	return success;
+}
+
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt) {
@@ -328,6 +410,166 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of free pages, pre-zeroed or not, in the
+   pool that FLAGS selects. */
+size_t
+palloc_free_count (enum palloc_flags flags) {
+	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	size_t size = bitmap_size (pool->used_map);
+	size_t free_cnt;
+
+	lock_acquire (&pool->lock);
+	free_cnt = (size - bitmap_count (pool->used_map, 0, size, true)
+			+ pool->zeroed_cnt);
+	lock_release (&pool->lock);
+	return free_cnt;
+}
+
+/* Starts the pagezero thread, which keeps the pools' stacks of
+   pre-zeroed pages filled.  Must be called after thread_start(). */
+void
+palloc_zero_start (void) {
+	sema_init (&zeroer_sema, 0);
+	thread_create ("pagezero", PRI_MIN, zeroer, NULL);
+}
+
+/* Returns the length of the longest run of free pages in POOL.
+   POOL's lock must be held. */
+static size_t
+largest_free_run (const struct pool *pool) {
+	size_t size = bitmap_size (pool->used_map);
+	size_t best = 0, start = 0;
+
+	while ((start = bitmap_scan (pool->used_map, start, 1, false))
+			!= BITMAP_ERROR) {
+		size_t end = bitmap_scan (pool->used_map, start, 1, true);
+		if (end == BITMAP_ERROR)
+			end = size;
+		if (end - start > best)
+			best = end - start;
+		if (end == size)
+			break;
+		start = end;
+	}
+	return best;
+}
+
+/* Prints how much of POOL, called NAME, is in use and how
+   fragmented its free pages are. */
+static void
+print_pool (struct pool *pool, const char *name) {
+	size_t size = bitmap_size (pool->used_map);
+	size_t used, zeroed, largest;
+
+	lock_acquire (&pool->lock);
+	used = bitmap_count (pool->used_map, 0, size, true);
+	zeroed = pool->zeroed_cnt;
+	largest = largest_free_run (pool);
+	lock_release (&pool->lock);
+
+	printf ("Palloc: %s pool: %zu of %zu pages used (%zu pre-zeroed), "
+			"largest free run %zu pages\n",
+			name, used - zeroed, size, zeroed, largest);
+}
+
+/* Prints pool usage and pre-zeroed page statistics. */
+void
+palloc_print_stats (void) {
+	print_pool (&kernel_pool, "kernel");
+	print_pool (&user_pool, "user");
+	printf ("Palloc: %zu zeroed-page hits, %zu misses\n",
+			kernel_pool.zero_hits + user_pool.zero_hits,
+			kernel_pool.zero_misses + user_pool.zero_misses);
+}
+
+/* Pops a page off POOL's pre-zeroed stack and returns it, or
+   returns a null pointer if the stack is empty. */
+static void *
+zeroed_pop (struct pool *pool) {
+	void *page = NULL;
+	bool low;
+
+	lock_acquire (&pool->lock);
+	if (pool->zeroed_cnt > 0) {
+		page = pool->zeroed[--pool->zeroed_cnt];
+		pool->zero_hits++;
+	}
+	low = pool->zeroed_cnt < ZEROED_LOW;
+	lock_release (&pool->lock);
+
+	if (low)
+		zeroer_wake ();
+	return page;
+}
+
+/* Returns every page on POOL's pre-zeroed stack to its bitmap.
+   POOL's lock must be held. */
+static void
+zeroed_release (struct pool *pool) {
+	ASSERT (lock_held_by_current_thread (&pool->lock));
+
+	while (pool->zeroed_cnt > 0) {
+		void *page = pool->zeroed[--pool->zeroed_cnt];
+		bitmap_reset (pool->used_map, pg_no (page) - pg_no (pool->base));
+	}
+}
+
+/* Adds one freshly zeroed page to POOL's pre-zeroed stack.
+   Returns false if the stack is full or POOL has no free page. */
+static bool
+zeroed_fill_one (struct pool *pool) {
+	size_t page_idx = BITMAP_ERROR;
+	void *page;
+
+	lock_acquire (&pool->lock);
+	if (pool->zeroed_cnt < ZEROED_MAX)
+		page_idx = bitmap_scan_and_flip (pool->used_map, 0, 1, false);
+	lock_release (&pool->lock);
+	if (page_idx == BITMAP_ERROR)
+		return false;
+
+	/* The page is ours now, so zero it without holding the lock. */
+	page = pool->base + PGSIZE * page_idx;
+	memset (page, 0, PGSIZE);
+
+	lock_acquire (&pool->lock);
+	if (pool->zeroed_cnt < ZEROED_MAX)
+		pool->zeroed[pool->zeroed_cnt++] = page;
+	else
+		bitmap_reset (pool->used_map, page_idx);
+	lock_release (&pool->lock);
+	return true;
+}
+
+/* Wakes the pagezero thread if it is waiting for work. */
+static void
+zeroer_wake (void) {
+	enum intr_level old_level = intr_disable ();
+	if (zeroer_sleeping) {
+		zeroer_sleeping = false;
+		sema_up (&zeroer_sema);
+	}
+	intr_set_level (old_level);
+}
+
+/* The pagezero thread.  Runs at PRI_MIN, so it only gets the CPU
+   when every other thread is blocked, and zeroes free pages until
+   both stacks are full, then waits to be woken. */
+static void
+zeroer (void *aux UNUSED) {
+	for (;;) {
+		bool progress = zeroed_fill_one (&kernel_pool);
+		progress |= zeroed_fill_one (&user_pool);
+
+		if (!progress) {
+			enum intr_level old_level = intr_disable ();
+			zeroer_sleeping = true;
+			intr_set_level (old_level);
+			sema_down (&zeroer_sema);
+		}
+	}
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
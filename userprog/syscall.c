@@ -7,6 +7,10 @@
 #include "userprog/gdt.h"
 #include "threads/flags.h"
 #include "intrinsic.h"
+#ifdef VM
+#include <mman.h>
+#include "vm/vm.h"
+#endif
 
 void syscall_entry (void);
 void syscall_handler (struct intr_frame *);
@@ -40,6 +44,24 @@ syscall_init (void) {
 /* The main system call interface */
 void
 syscall_handler (struct intr_frame *f UNUSED) {
+	switch (f->R.rax) {
+#ifdef VM
+		case SYS_MADVISE:
+			f->R.rax = vm_madvise ((void *) f->R.rdi, f->R.rsi, f->R.rdx);
+			return;
+		case SYS_MMAP:
+			if (f->R.rdx & MAP_ANON) {
+				f->R.rax = (uint64_t) vm_mmap_anon ((void *) f->R.rdi, f->R.rsi,
+						f->R.rdx);
+				return;
+			}
+			break;
+		case SYS_MUNMAP:
+			do_munmap ((void *) f->R.rdi);
+			return;
+#endif
+	}
+
 	// TODO: Your implementation goes here.
 	printf ("system call!\n");
 	thread_exit ();
@@ -1,6 +1,8 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
+#include <bitmap.h>
 #include "vm/vm.h"
+#include "vm/swap.h"
 #include "devices/disk.h"
 
 /* DO NOT MODIFY BELOW LINE */
@@ -20,8 +22,8 @@ static const struct page_operations anon_ops = {
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	swap_disk = disk_get (1, 1);
+	swap_init (swap_disk);
 }
 
 /* Initialize the file mapping */
@@ -31,22 +33,37 @@ anon_initializer (struct page *page, enum vm_type type, void *kva) {
 	page->operations = &anon_ops;
 
 	struct anon_page *anon_page = &page->anon;
+	anon_page->slot = BITMAP_ERROR;
+	return true;
 }
 
 /* Swap in the page by read contents from the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+
+	if (anon_page->slot == BITMAP_ERROR || !swap_read (anon_page->slot, kva))
+		return false;
+	anon_page->slot = BITMAP_ERROR;
+	return true;
 }
 
 /* Swap out the page by writing contents to the swap disk. */
 static bool
 anon_swap_out (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	anon_page->slot = swap_write (page->frame->kva);
+	return anon_page->slot != BITMAP_ERROR;
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	/* Waits out an eviction in progress, which may assign a slot. */
+	vm_free_frame (page);
+	if (anon_page->slot != BITMAP_ERROR)
+		swap_free (anon_page->slot);
 }
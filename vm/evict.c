@@ -0,0 +1,459 @@
+/* evict.c: Page replacement policies.
+ *
+ * The policies only see the hardware accessed bits, which they sample
+ * and clear while looking for a victim, never individual accesses.  So
+ * the LRU lists of 2Q and ARC are approximated by clocks: a frame that
+ * comes up at the head of a list with its accessed bit set goes around
+ * again instead of being evicted, as in CAR (Bansal and Modha's Clock
+ * with Adaptive Replacement).
+ *
+ * 2Q and ARC also remember recently evicted pages on ghost lists.  A
+ * page that faults back in while it still has a ghost was evicted too
+ * early, which 2Q answers by promoting it and ARC by also shifting its
+ * balance between recency and frequency. */
+
+#include "vm/evict.h"
+#include <list.h>
+#include <ohash.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "vm/vm.h"
+
+/* Policy lists.  2Q calls them A1in and Am, ARC calls them T1 and T2. */
+enum evict_queue {
+	QUEUE_RECENT,                /* Seen once. */
+	QUEUE_FREQUENT,              /* Seen again. */
+};
+
+/* List of frames. */
+struct frame_queue {
+	struct list frames;          /* Oldest first. */
+	size_t cnt;                  /* Number of frames. */
+};
+
+/* List of recently evicted pages. */
+struct ghost_list {
+	struct list ghosts;          /* Oldest first. */
+	size_t cnt;                  /* Number of ghosts. */
+};
+
+/* A recently evicted page. */
+struct ghost {
+	struct ohash_elem hash_elem; /* Element in all_ghosts. */
+	struct list_elem list_elem;  /* Element in LIST. */
+	const struct page *page;     /* The evicted page. */
+	struct ghost_list *list;     /* List holding this ghost. */
+};
+
+static struct frame_queue queues[2];   /* Indexed by enum evict_queue. */
+static struct ghost_list ghost_lists[2];  /* Ghosts of pages evicted from
+                                             each queue. */
+static struct ohash all_ghosts;        /* Every ghost, by page. */
+
+static size_t capacity;        /* Most frames ever tracked at once. */
+static size_t arc_target;      /* ARC's target size for QUEUE_RECENT. */
+
+/* Statistics. */
+static size_t ghost_hits[2];   /* Refaults, by ghost list. */
+
+static uint64_t ghost_hash (const struct ohash_elem *, void *);
+static bool ghost_less (const struct ohash_elem *, const struct ohash_elem *,
+		void *);
+
+/* Initializes the lists shared by the policies. */
+void
+evict_init (void) {
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		list_init (&queues[i].frames);
+		list_init (&ghost_lists[i].ghosts);
+	}
+	if (!ohash_init (&all_ghosts, ghost_hash, ghost_less, NULL))
+		PANIC ("evict_init: out of memory");
+}
+
+/* Frame queues. */
+
+/* Appends FRAME to queue Q. */
+static void
+queue_push (struct frame *frame, enum evict_queue q) {
+	frame->queue = q;
+	list_push_back (&queues[q].frames, &frame->elem);
+	queues[q].cnt++;
+}
+
+/* Removes FRAME from its queue. */
+static void
+queue_remove (struct frame *frame) {
+	list_remove (&frame->elem);
+	queues[frame->queue].cnt--;
+}
+
+/* Returns the oldest frame in queue Q. */
+static struct frame *
+queue_front (enum evict_queue q) {
+	return list_entry (list_front (&queues[q].frames), struct frame, elem);
+}
+
+/* Moves FRAME to the back of queue Q. */
+static void
+queue_move (struct frame *frame, enum evict_queue q) {
+	queue_remove (frame);
+	queue_push (frame, q);
+}
+
+/* Number of frames in both queues. */
+static size_t
+queue_total (void) {
+	return queues[QUEUE_RECENT].cnt + queues[QUEUE_FREQUENT].cnt;
+}
+
+/* Ghosts. */
+
+/* Remembers that PAGE was just evicted, on LIST. */
+static void
+ghost_add (struct ghost_list *list, const struct page *page) {
+	struct ghost *g = malloc (sizeof *g);
+
+	/* Ghosts are only hints. */
+	if (g == NULL)
+		return;
+	g->page = page;
+	g->list = list;
+	list_push_back (&list->ghosts, &g->list_elem);
+	list->cnt++;
+	ohash_insert (&all_ghosts, &g->hash_elem);
+}
+
+/* Returns PAGE's ghost, or a null pointer. */
+static struct ghost *
+ghost_find (const struct page *page) {
+	struct ghost key;
+	struct ohash_elem *e;
+
+	key.page = page;
+	e = ohash_find (&all_ghosts, &key.hash_elem);
+	return e != NULL ? ohash_entry (e, struct ghost, hash_elem) : NULL;
+}
+
+/* Forgets ghost G. */
+static void
+ghost_drop (struct ghost *g) {
+	list_remove (&g->list_elem);
+	g->list->cnt--;
+	ohash_delete (&all_ghosts, &g->hash_elem);
+	free (g);
+}
+
+/* Forgets the oldest ghosts on LIST until at most MAX remain. */
+static void
+ghost_trim (struct ghost_list *list, size_t max) {
+	while (list->cnt > max)
+		ghost_drop (list_entry (list_front (&list->ghosts), struct ghost,
+					list_elem));
+}
+
+/* Forgets PAGE's ghost, if any, so that a new page allocated at the same
+ * address is not mistaken for it. */
+static void
+ghost_forget (struct page *page) {
+	struct ghost *g = ghost_find (page);
+
+	if (g != NULL)
+		ghost_drop (g);
+}
+
+/* Consumes PAGE's ghost and returns the queue it was evicted from, or
+ * -1 if PAGE has no ghost. */
+static int
+ghost_claim (const struct page *page) {
+	struct ghost *g = ghost_find (page);
+	int q;
+
+	if (g == NULL)
+		return -1;
+	q = g->list - ghost_lists;
+	ghost_hits[q]++;
+	ghost_drop (g);
+	return q;
+}
+
+static uint64_t
+ghost_hash (const struct ohash_elem *e, void *aux UNUSED) {
+	return ohash_u64 ((uintptr_t) ohash_entry (e, struct ghost,
+				hash_elem)->page);
+}
+
+static bool
+ghost_less (const struct ohash_elem *a, const struct ohash_elem *b,
+		void *aux UNUSED) {
+	return (ohash_entry (a, struct ghost, hash_elem)->page
+			< ohash_entry (b, struct ghost, hash_elem)->page);
+}
+
+/* Shared policy hooks. */
+
+/* Stops tracking FRAME. */
+static void
+common_remove (struct frame *frame) {
+	queue_remove (frame);
+}
+
+/* Updates the capacity estimate after a frame was added.  Eviction
+ * starts only once the user pool is full, so the most frames ever
+ * tracked is the pool size as the policies see it. */
+static void
+count_frame (void) {
+	if (queue_total () > capacity)
+		capacity = queue_total ();
+}
+
+/* Clock: second chance over a single list, preferring clean file
+ * pages, which can be dropped without I/O. */
+
+static struct list_elem *clock_hand;   /* Next frame to look at. */
+
+static void
+clock_insert (struct frame *frame) {
+	/* Just behind the hand, so that the new frame is looked at last. */
+	frame->queue = QUEUE_RECENT;
+	if (clock_hand != NULL
+			&& clock_hand != list_end (&queues[QUEUE_RECENT].frames))
+		list_insert (clock_hand, &frame->elem);
+	else
+		list_push_back (&queues[QUEUE_RECENT].frames, &frame->elem);
+	queues[QUEUE_RECENT].cnt++;
+	count_frame ();
+}
+
+static void
+clock_remove (struct frame *frame) {
+	if (clock_hand == &frame->elem)
+		clock_hand = list_next (clock_hand);
+	queue_remove (frame);
+}
+
+/* Sweeps the hand over the frames, giving each recently accessed frame a
+ * second chance.  The first unaccessed clean file page wins outright;
+ * otherwise, after one full sweep, the first unaccessed frame of any kind
+ * does. */
+static struct frame *
+clock_victim (void) {
+	struct list *frames = &queues[QUEUE_RECENT].frames;
+	size_t cnt = queues[QUEUE_RECENT].cnt;
+	struct frame *victim = NULL;
+	size_t i;
+
+	for (i = 0; i < 2 * cnt; i++) {
+		struct frame *frame;
+
+		if (i == cnt && victim != NULL)
+			break;
+		if (clock_hand == NULL || clock_hand == list_end (frames))
+			clock_hand = list_begin (frames);
+		frame = list_entry (clock_hand, struct frame, elem);
+		clock_hand = list_next (clock_hand);
+
+		if (frame->busy || frame_test_and_clear_accessed (frame))
+			continue;
+		if (frame_is_clean_file (frame)) {
+			victim = frame;
+			break;
+		}
+		if (victim == NULL)
+			victim = frame;
+		if (i >= cnt)
+			break;
+	}
+	if (victim != NULL)
+		clock_remove (victim);
+	return victim;
+}
+
+static const struct evict_policy clock_policy = {
+	.name = "clock",
+	.insert = clock_insert,
+	.remove = clock_remove,
+	.victim = clock_victim,
+};
+
+/* 2Q (Johnson and Shasha).  New pages enter A1in, a FIFO of about a
+ * quarter of memory, and are evicted from it onto the A1out ghost list.
+ * Only pages that fault back in while on A1out reach Am, so a
+ * sequential scan flushes A1in but leaves the hot pages in Am alone. */
+
+/* Returns the size of A1in above which it gives up frames. */
+static size_t
+twoq_kin (void) {
+	return capacity / 4 > 0 ? capacity / 4 : 1;
+}
+
+/* Returns the number of ghosts kept on A1out. */
+static size_t
+twoq_kout (void) {
+	return capacity / 2 > 0 ? capacity / 2 : 1;
+}
+
+static void
+twoq_insert (struct frame *frame) {
+	if (ghost_claim (frame->page) == QUEUE_RECENT)
+		queue_push (frame, QUEUE_FREQUENT);
+	else
+		queue_push (frame, QUEUE_RECENT);
+	count_frame ();
+}
+
+static struct frame *
+twoq_victim (void) {
+	size_t i, tries = 2 * queue_total () + 2;
+
+	for (i = 0; i < tries; i++) {
+		enum evict_queue q = (queues[QUEUE_RECENT].cnt > twoq_kin ()
+				|| queues[QUEUE_FREQUENT].cnt == 0)
+			? QUEUE_RECENT : QUEUE_FREQUENT;
+		struct frame *frame;
+
+		if (queues[q].cnt == 0)
+			return NULL;
+		frame = queue_front (q);
+
+		/* A1in is a plain FIFO; Am gives a second chance. */
+		if (frame->busy || (q == QUEUE_FREQUENT
+					&& frame_test_and_clear_accessed (frame))) {
+			queue_move (frame, q);
+			continue;
+		}
+		queue_remove (frame);
+		if (q == QUEUE_RECENT) {
+			ghost_add (&ghost_lists[QUEUE_RECENT], frame->page);
+			ghost_trim (&ghost_lists[QUEUE_RECENT], twoq_kout ());
+		}
+		return frame;
+	}
+	return NULL;
+}
+
+static const struct evict_policy twoq_policy = {
+	.name = "2q",
+	.insert = twoq_insert,
+	.remove = common_remove,
+	.victim = twoq_victim,
+	.forget = ghost_forget,
+};
+
+/* ARC (Megiddo and Modha), in its CAR form.  T1 holds pages seen once
+ * and T2 pages seen again; B1 and B2 are their ghost lists.  A refault
+ * from B1 means T1 was too small and grows its target size, one from B2
+ * shrinks it, so the split between recency and frequency adapts to the
+ * workload. */
+
+static void
+arc_insert (struct frame *frame) {
+	size_t b1 = ghost_lists[QUEUE_RECENT].cnt;
+	size_t b2 = ghost_lists[QUEUE_FREQUENT].cnt;
+	size_t delta;
+
+	switch (ghost_claim (frame->page)) {
+		case QUEUE_RECENT:
+			delta = b2 > b1 ? b2 / b1 : 1;
+			arc_target = (arc_target + delta < capacity
+					? arc_target + delta : capacity);
+			queue_push (frame, QUEUE_FREQUENT);
+			break;
+		case QUEUE_FREQUENT:
+			delta = b1 > b2 ? b1 / b2 : 1;
+			arc_target = arc_target > delta ? arc_target - delta : 0;
+			queue_push (frame, QUEUE_FREQUENT);
+			break;
+		default:
+			/* Keep T1 + B1 and the whole directory within bounds. */
+			if (queues[QUEUE_RECENT].cnt + b1 >= capacity && b1 > 0)
+				ghost_trim (&ghost_lists[QUEUE_RECENT], b1 - 1);
+			else if (queue_total () + b1 + b2 >= 2 * capacity && b2 > 0)
+				ghost_trim (&ghost_lists[QUEUE_FREQUENT], b2 - 1);
+			queue_push (frame, QUEUE_RECENT);
+			break;
+	}
+	count_frame ();
+}
+
+static struct frame *
+arc_victim (void) {
+	size_t i, tries = 3 * queue_total () + 3;
+
+	for (i = 0; i < tries; i++) {
+		size_t target = arc_target > 0 ? arc_target : 1;
+		enum evict_queue q = ((queues[QUEUE_RECENT].cnt >= target
+					&& queues[QUEUE_RECENT].cnt > 0)
+				|| queues[QUEUE_FREQUENT].cnt == 0)
+			? QUEUE_RECENT : QUEUE_FREQUENT;
+		struct frame *frame;
+
+		if (queues[q].cnt == 0)
+			return NULL;
+		frame = queue_front (q);
+		if (frame->busy) {
+			queue_move (frame, q);
+			continue;
+		}
+
+		/* A page used again is promoted to (the back of) T2. */
+		if (frame_test_and_clear_accessed (frame)) {
+			queue_move (frame, QUEUE_FREQUENT);
+			continue;
+		}
+		queue_remove (frame);
+		ghost_add (&ghost_lists[q], frame->page);
+		ghost_trim (&ghost_lists[q], capacity);
+		return frame;
+	}
+	return NULL;
+}
+
+static const struct evict_policy arc_policy = {
+	.name = "arc",
+	.insert = arc_insert,
+	.remove = common_remove,
+	.victim = arc_victim,
+	.forget = ghost_forget,
+};
+
+/* Policy selection. */
+
+/* All the policies, the default first. */
+static const struct evict_policy *const policies[] = {
+	&clock_policy, &twoq_policy, &arc_policy,
+};
+
+/* The policy in use. */
+const struct evict_policy *evict_policy = &clock_policy;
+
+/* Makes the policy called NAME the one in use.  Returns false if there
+ * is no such policy.  Must be called before evict_init(). */
+bool
+evict_select (const char *name) {
+	size_t i;
+
+	for (i = 0; i < sizeof policies / sizeof *policies; i++)
+		if (!strcmp (policies[i]->name, name)) {
+			evict_policy = policies[i];
+			return true;
+		}
+	return false;
+}
+
+/* Prints what the policy in use learned from its ghost lists. */
+void
+evict_print_stats (void) {
+	if (evict_policy->forget == NULL)
+		return;
+	printf ("Evict: %zu ghost hits from recent pages, %zu from frequent "
+			"pages, %zu ghosts kept", ghost_hits[QUEUE_RECENT],
+			ghost_hits[QUEUE_FREQUENT], ohash_size (&all_ghosts));
+	if (evict_policy == &arc_policy)
+		printf (", target %zu of %zu frames for recent pages",
+				arc_target, capacity);
+	printf ("\n");
+}
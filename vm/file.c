@@ -1,6 +1,7 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
 #include "vm/vm.h"
+#include "threads/vaddr.h"
 
 static bool file_backed_swap_in (struct page *page, void *kva);
 static bool file_backed_swap_out (struct page *page);
@@ -26,6 +27,7 @@ file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
 	page->operations = &file_ops;
 
 	struct file_page *file_page = &page->file;
+	return true;
 }
 
 /* Swap in the page by read contents from the file. */
@@ -44,6 +46,7 @@ file_backed_swap_out (struct page *page) {
 static void
 file_backed_destroy (struct page *page) {
 	struct file_page *file_page UNUSED = &page->file;
+	vm_free_frame (page);
 }
 
 /* Do the mmap */
@@ -52,7 +55,40 @@ do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
 }
 
+/* A mapping being unmapped. */
+struct unmap_range {
+	void *start;           /* First page. */
+	void *end;             /* End of the pages found so far. */
+	bool anon;             /* Anonymous mapping? */
+};
+
+/* spt_for_each() helper for do_munmap().  Extends the mapping in R over
+ * PAGE if PAGE directly follows it and is part of it: for an anonymous
+ * mapping, a page mapped with it; for a file mapping, a file-backed page
+ * of no anonymous mapping.  The first page decides which it is. */
+static bool
+extend_mapping (struct page *page, void *r_) {
+	struct unmap_range *r = r_;
+
+	if (page->va != r->end)
+		return false;
+	if (page->va == r->start)
+		r->anon = page->mapping == r->start;
+	if (r->anon ? page->mapping != r->start
+			: page->mapping != NULL || page_get_type (page) != VM_FILE)
+		return false;
+	r->end = page->va + PGSIZE;
+	return true;
+}
+
 /* Do the munmap */
 void
 do_munmap (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct unmap_range r = { addr, addr, false };
+
+	/* The mapping is the run of pages starting at ADDR that belong to
+	 * it. */
+	spt_for_each (spt, addr, (void *) KERN_BASE, extend_mapping, &r);
+	spt_remove_range (spt, addr, r.end);
 }
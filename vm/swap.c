@@ -0,0 +1,320 @@
+/* swap.c: Slots for anonymous pages on the swap disk.
+ *
+ * The swap disk is divided into page-sized slots, allocated next-fit
+ * from a bitmap, so that pages swapped out one after another land next
+ * to each other.  Between swap_batch_begin() and swap_batch_end(),
+ * swap_write() only queues pages, in slots reserved together, and
+ * swap_batch_end() writes each run of adjacent slots with one disk
+ * command.
+ *
+ * swap_read() reads, with one disk command, the whole run of slots in
+ * use around the one asked for, within its aligned cluster of
+ * SWAP_CLUSTER slots.  Pages evicted together tend to be needed again
+ * together, so the neighbors are kept in a small cache for the faults
+ * that are likely to follow.
+ *
+ * Before any of that, zswap gets a chance to keep each page compressed
+ * in memory, in which case its slot is reserved but never written. */
+
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/disk.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/zswap.h"
+
+#define SLOT_SECTORS (PGSIZE / DISK_SECTOR_SIZE)  /* Sectors per slot. */
+#define SWAP_CLUSTER 8          /* Most slots read by one command. */
+#define SWAP_BATCH 16           /* Most pages queued by a batch. */
+#define SWAP_CACHE 16           /* Pages of read-ahead kept. */
+
+static struct disk *swap_disk;
+static struct bitmap *swap_map;       /* Slots in use. */
+static size_t swap_cursor;            /* Start of the next-fit search. */
+
+/* Serializes swap I/O and protects the state below, so that a read
+ * never sees a slot whose write is still queued.  A batch holds it from
+ * swap_batch_begin() to swap_batch_end(). */
+static struct lock swap_lock;
+
+/* A page waiting to be written. */
+struct swap_request {
+	size_t slot;                      /* Destination slot. */
+	const void *kva;                  /* Page contents. */
+};
+
+/* Batch in progress. */
+static struct swap_request batch[SWAP_BATCH];  /* Queued pages. */
+static size_t batch_cnt;              /* Number of queued pages. */
+static size_t batch_next, batch_end;  /* Reserved slots not used yet. */
+
+/* A page read ahead. */
+struct swap_cache_entry {
+	size_t slot;                      /* Slot read, or BITMAP_ERROR. */
+	void *page;                       /* Its contents. */
+};
+
+static struct swap_cache_entry cache[SWAP_CACHE];
+static size_t cache_hand;             /* Next entry to replace. */
+
+/* Sector buffers for one disk command. */
+static const void *out_sectors[SWAP_BATCH * SLOT_SECTORS];
+static void *in_sectors[SWAP_CLUSTER * SLOT_SECTORS];
+
+/* Statistics. */
+static size_t pages_out;              /* Pages written. */
+static size_t write_cmds;             /* Disk commands writing them. */
+static size_t pages_in;               /* Pages read back. */
+static size_t read_cmds;              /* Disk commands reading them. */
+static size_t sectors_read;           /* Sectors those commands read. */
+static size_t cache_hits;             /* Pages found read ahead. */
+
+/* Sets up swapping to DISK, which may be a null pointer if there is no
+ * swap disk. */
+void
+swap_init (struct disk *disk) {
+	size_t i;
+
+	swap_disk = disk;
+	swap_map = bitmap_create (disk != NULL
+			? disk_size (disk) / SLOT_SECTORS : 0);
+	if (swap_map == NULL)
+		PANIC ("swap_init: cannot allocate swap map");
+	lock_init (&swap_lock);
+
+	for (i = 0; i < SWAP_CACHE; i++) {
+		cache[i].slot = BITMAP_ERROR;
+		cache[i].page = disk != NULL ? palloc_get_page (PAL_ASSERT) : NULL;
+	}
+	zswap_init ();
+}
+
+/* Returns the read-ahead cache entry for SLOT, or a null pointer. */
+static struct swap_cache_entry *
+cache_find (size_t slot) {
+	size_t i;
+
+	for (i = 0; i < SWAP_CACHE; i++)
+		if (cache[i].slot == slot)
+			return &cache[i];
+	return NULL;
+}
+
+/* Allocates a slot, preferring one reserved by the batch in progress.
+ * Returns BITMAP_ERROR if swap is full. */
+static size_t
+alloc_slot (void) {
+	size_t slot;
+
+	if (batch_next < batch_end)
+		return batch_next++;
+	slot = bitmap_scan_next (swap_map, &swap_cursor, 1, false);
+	if (slot != BITMAP_ERROR)
+		bitmap_mark (swap_map, slot);
+	return slot;
+}
+
+/* Writes the CNT pages in REQS, whose slots are consecutive, with one
+ * disk command. */
+static void
+write_run (const struct swap_request *reqs, size_t cnt) {
+	size_t i, j;
+
+	for (i = 0; i < cnt; i++) {
+		ASSERT (reqs[i].slot == reqs[0].slot + i);
+		for (j = 0; j < SLOT_SECTORS; j++)
+			out_sectors[i * SLOT_SECTORS + j] = reqs[i].kva
+				+ j * DISK_SECTOR_SIZE;
+	}
+	disk_write_sectors (swap_disk, reqs[0].slot * SLOT_SECTORS, out_sectors,
+			cnt * SLOT_SECTORS);
+	write_cmds++;
+}
+
+/* Writes the queued pages, one disk command per run of adjacent
+ * slots. */
+static void
+flush_batch (void) {
+	size_t i, j, run;
+
+	/* Sort by slot.  The batch is short and usually sorted already. */
+	for (i = 1; i < batch_cnt; i++) {
+		struct swap_request r = batch[i];
+		for (j = i; j > 0 && batch[j - 1].slot > r.slot; j--)
+			batch[j] = batch[j - 1];
+		batch[j] = r;
+	}
+
+	for (i = 0; i < batch_cnt; i += run) {
+		for (run = 1; i + run < batch_cnt; run++)
+			if (batch[i + run].slot != batch[i].slot + run)
+				break;
+		write_run (&batch[i], run);
+	}
+	batch_cnt = 0;
+}
+
+/* Starts a batch of up to PAGE_CNT calls to swap_write(), for which as
+ * many adjacent slots are reserved as possible. */
+void
+swap_batch_begin (size_t page_cnt) {
+	size_t cnt = page_cnt < SWAP_BATCH ? page_cnt : SWAP_BATCH;
+
+	lock_acquire (&swap_lock);
+	batch_cnt = 0;
+	batch_next = batch_end = 0;
+	for (; cnt > 0; cnt /= 2) {
+		size_t slot = bitmap_scan_next (swap_map, &swap_cursor, cnt, false);
+		if (slot != BITMAP_ERROR) {
+			bitmap_set_multiple (swap_map, slot, cnt, true);
+			batch_next = slot;
+			batch_end = slot + cnt;
+			break;
+		}
+	}
+}
+
+/* Writes out the pages queued since swap_batch_begin(). */
+void
+swap_batch_end (void) {
+	flush_batch ();
+	if (batch_next < batch_end)
+		bitmap_set_multiple (swap_map, batch_next, batch_end - batch_next,
+				false);
+	batch_next = batch_end = 0;
+	lock_release (&swap_lock);
+}
+
+/* Writes the page at KVA to a free slot and returns the slot, or
+ * BITMAP_ERROR if swap is full.  Within a batch the page is only queued,
+ * so it must not change before swap_batch_end(). */
+size_t
+swap_write (const void *kva) {
+	bool batched = lock_held_by_current_thread (&swap_lock);
+	size_t slot;
+
+	if (!batched)
+		lock_acquire (&swap_lock);
+	slot = alloc_slot ();
+	if (slot != BITMAP_ERROR && !zswap_store (slot, kva)) {
+		pages_out++;
+		if (batched) {
+			if (batch_cnt == SWAP_BATCH)
+				flush_batch ();
+			batch[batch_cnt].slot = slot;
+			batch[batch_cnt++].kva = kva;
+		} else {
+			struct swap_request r = { slot, kva };
+			write_run (&r, 1);
+		}
+	}
+	if (!batched)
+		lock_release (&swap_lock);
+	return slot;
+}
+
+/* Returns true if SLOT holds a page that is on disk and not read ahead
+ * already. */
+static bool
+worth_reading (size_t slot) {
+	return (bitmap_test (swap_map, slot) && cache_find (slot) == NULL
+			&& !zswap_contains (slot));
+}
+
+/* Reads SLOT into KVA, along with its neighbors in the cluster, which go
+ * to the cache. */
+static void
+read_cluster (size_t slot, void *kva) {
+	size_t start = slot - slot % SWAP_CLUSTER;
+	size_t end = start + SWAP_CLUSTER;
+	size_t first = slot, last = slot + 1;
+	size_t i, j;
+
+	if (end > bitmap_size (swap_map))
+		end = bitmap_size (swap_map);
+	while (first > start && worth_reading (first - 1))
+		first--;
+	while (last < end && worth_reading (last))
+		last++;
+
+	for (i = first; i < last; i++) {
+		void *page = kva;
+
+		if (i != slot) {
+			struct swap_cache_entry *e = &cache[cache_hand];
+			cache_hand = (cache_hand + 1) % SWAP_CACHE;
+			e->slot = i;
+			page = e->page;
+		}
+		for (j = 0; j < SLOT_SECTORS; j++)
+			in_sectors[(i - first) * SLOT_SECTORS + j] = page
+				+ j * DISK_SECTOR_SIZE;
+	}
+	disk_read_sectors (swap_disk, first * SLOT_SECTORS, in_sectors,
+			(last - first) * SLOT_SECTORS);
+	read_cmds++;
+	sectors_read += (last - first) * SLOT_SECTORS;
+}
+
+/* Reads the page in SLOT into KVA and frees SLOT. */
+bool
+swap_read (size_t slot, void *kva) {
+	struct swap_cache_entry *e;
+
+	lock_acquire (&swap_lock);
+	ASSERT (bitmap_test (swap_map, slot));
+	e = cache_find (slot);
+	if (e != NULL) {
+		memcpy (kva, e->page, PGSIZE);
+		e->slot = BITMAP_ERROR;
+		cache_hits++;
+	} else if (!zswap_load (slot, kva))
+		read_cluster (slot, kva);
+	bitmap_reset (swap_map, slot);
+	pages_in++;
+	lock_release (&swap_lock);
+	return true;
+}
+
+/* Frees SLOT without reading it. */
+void
+swap_free (size_t slot) {
+	struct swap_cache_entry *e;
+
+	lock_acquire (&swap_lock);
+	e = cache_find (slot);
+	if (e != NULL)
+		e->slot = BITMAP_ERROR;
+	zswap_invalidate (slot);
+	bitmap_reset (swap_map, slot);
+	lock_release (&swap_lock);
+}
+
+/* Returns the number of free slots. */
+size_t
+swap_available (void) {
+	size_t cnt;
+
+	lock_acquire (&swap_lock);
+	cnt = bitmap_count (swap_map, 0, bitmap_size (swap_map), false);
+	lock_release (&swap_lock);
+	return cnt;
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void) {
+	size_t per_fault = pages_in > 0 ? sectors_read * 10 / pages_in : 0;
+
+	printf ("Swap: %zu pages written by %zu commands, %zu read by %zu "
+			"commands (%zu read ahead), %zu.%zu sectors per fault, "
+			"%zu slots in use\n",
+			pages_out, write_cmds, pages_in, read_cmds, cache_hits,
+			per_fault / 10, per_fault % 10,
+			bitmap_count (swap_map, 0, bitmap_size (swap_map), true));
+	zswap_print_stats ();
+}
@@ -1,8 +1,167 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <mman.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
 #include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
+#include "vm/evict.h"
 #include "vm/inspect.h"
+#include "vm/swap.h"
+#include "intrinsic.h"
+
+/* Supplemental page table radix tree.  A node is one page of
+ * SPT_FANOUT pointers.  Level 0 nodes hold struct page pointers and are
+ * indexed by the same bits as a page table; each level above is indexed
+ * by the next 9 bits, like the page directory, PDPT and PML4. */
+#define SPT_LEVELS 4
+#define SPT_FANOUT (PGSIZE / sizeof (void *))
+#define SPT_SHIFT(LEVEL) (PTXSHIFT + 9 * (LEVEL))
+#define SPT_IDX(VA, LEVEL) \
+	(((uintptr_t) (VA) >> SPT_SHIFT (LEVEL)) & (SPT_FANOUT - 1))
+#define SPT_LEAF_SPAN (1UL << SPT_SHIFT (1))  /* Bytes under one leaf. */
+
+/* Statistics, summed over all supplemental page tables. */
+static size_t spt_pages;             /* Pages in all tables. */
+static size_t spt_nodes;             /* Radix tree nodes. */
+static size_t spt_peak_pages;        /* Highest spt_pages seen. */
+static size_t spt_peak_nodes;        /* Highest spt_nodes seen. */
+static uint64_t spt_lookups;         /* Calls to spt_find_page(), timed
+                                        only with -spt-time. */
+static uint64_t spt_lookup_cycles;   /* Cycles spent in them. */
+
+/* -spt-time: Time supplemental page table lookups? */
+bool spt_timing;
+
+/* Protects the eviction policy's frame lists and the sharing state of
+ * frames: struct frame's PAGES, REF_CNT and BUSY and struct page's
+ * FRAME. */
+static struct lock frame_lock;
+static struct condition frame_done;  /* Signaled when a frame stops being
+                                        busy. */
+
+/* Every frame holding user pages. */
+static struct list frame_table;
+
+/* Frame of zeros, mapped read-only by every anonymous page that has
+ * been read but never written.  A write fault gives the page a frame of
+ * its own.  It is not in frame_table, so it is never evicted, and it is
+ * never freed. */
+static struct frame zero_frame;
+
+/* Most frames evicted at once. */
+#define EVICT_BATCH 8
+
+/* Background reclaim.  When an allocation leaves fewer than free_low
+ * free user frames, the kswapd thread is woken to evict frames, in
+ * batches, until there are free_high free, so that faults find a free
+ * frame instead of waiting for a page to be written out.  A fault
+ * evicts by itself only when there is no free frame at all. */
+static size_t free_low, free_high;   /* Watermarks, in free frames. */
+static struct semaphore kswapd_wake; /* Upped to wake kswapd. */
+static bool kswapd_awake;            /* Woken and not done yet? */
+
+/* Background reclaim statistics. */
+static size_t kswapd_wakeups;        /* Times woken. */
+static size_t kswapd_reclaimed;      /* Frames it freed. */
+static size_t direct_reclaims;       /* Faults that had to evict. */
+
+static void kswapd (void *aux);
+
+/* Frame and eviction statistics. */
+static size_t frame_cnt;             /* Frames in frame_table. */
+static size_t page_ins;              /* Pages brought into frames. */
+static size_t evict_clean;           /* Clean file pages dropped. */
+static size_t evict_dirty;           /* Dirty or anonymous pages written. */
+
+/* Working-set sampling and load control.  Every WS_INTERVAL ticks the
+ * wsd thread samples and clears the accessed bits of every resident
+ * page.  A process's working set is the number of its resident pages
+ * referenced in the last WS_WINDOW samples.  When the fault rate shows
+ * that the processes' working sets do not fit in memory together, the
+ * lowest-priority process is suspended: at its next fault from user mode
+ * it swaps out its frames and waits until the fault rate drops. */
+#define WS_INTERVAL (TIMER_FREQ / 4)  /* Ticks between samples. */
+#define WS_WINDOW 4                   /* Samples in a working set. */
+#define LOAD_FAULTS_HIGH 64           /* Faults per sample when thrashing. */
+#define LOAD_FAULTS_LOW 8             /* Faults per sample when calm. */
+
+static unsigned ws_epoch;            /* Number of samples taken. */
+static unsigned load_changed;        /* Sample of the last suspend/resume. */
+static struct list suspended;        /* Suspended processes, oldest first. */
+static struct condition resumed;     /* Signaled when one is resumed. */
+
+/* Load control statistics. */
+static size_t ws_peak;               /* Largest combined working set. */
+static size_t load_suspends;         /* Processes suspended. */
+static size_t load_resumes;          /* Processes resumed. */
+static size_t load_swapped;          /* Frames given up by suspended
+                                        processes. */
+
+static void wsd (void *aux);
+
+/* Fault-around.  A fault on a page whose contents come from a file also
+ * brings in the pages after it in the same mapping, as long as there are
+ * free frames for them, saving a trap and a small read for each.  The
+ * window starts at FAULT_AROUND_MIN pages and doubles, up to
+ * FAULT_AROUND_MAX, each time a process faults on the page right after
+ * the previous window, that is, while it reads sequentially. */
+#define FAULT_AROUND_MIN 2            /* Pages mapped by a random fault. */
+#define FAULT_AROUND_MAX 32           /* Most pages mapped by one fault. */
+
+/* Fault-around statistics. */
+static size_t around_faults;         /* Faults that looked around. */
+static size_t around_pages;          /* Extra pages they mapped. */
+static size_t around_sequential;     /* Faults that found a sequential
+                                        reader. */
+
+/* madvise() and populate statistics. */
+static size_t advise_prefetched;     /* Pages read in for MADV_WILLNEED. */
+static size_t advise_dropped;        /* Pages dropped for MADV_DONTNEED. */
+static size_t populated;             /* Pages read in by vm_populate(). */
+
+/* Zero frame statistics. */
+static size_t zero_maps;             /* Read faults that mapped it. */
+static size_t zero_copied;           /* Write faults that left it. */
+
+/* Kernel same-page merging.  Every KSM_INTERVAL ticks the ksmd thread
+ * hashes the next ksm_pages_to_scan frames of anonymous pages, going
+ * around the frame table.  A frame whose hash did not change since the
+ * last time around is entered in ksm_table, by hash, and when another
+ * one turns up with the same hash and the same contents, its pages are
+ * moved to the first one, mapped read-only, and it is freed.  A write to
+ * a merged page then copies it like any other copy-on-write page.  The
+ * table is emptied after every sweep of the frame table, so that frames
+ * that changed since are not kept in it. */
+#define KSM_INTERVAL (TIMER_FREQ / 4) /* Ticks between scans. */
+
+/* Frames scanned per KSM_INTERVAL, set by the -ksm option.  0, the
+ * default, turns merging off. */
+size_t ksm_pages_to_scan = 0;
+
+static struct ohash ksm_table;       /* Stable frames of this sweep. */
+static size_t ksm_sweep_pos;         /* Frames scanned in this sweep. */
+
+/* KSM statistics. */
+static size_t ksm_scanned;           /* Frames scanned. */
+static size_t ksm_sweeps;            /* Sweeps of the frame table. */
+static size_t ksm_merges;            /* Frames freed by merging. */
+static size_t ksm_zero_merges;       /* ...into the zero frame. */
+
+static void ksmd (void *aux);
+static uint64_t ksm_hash (const struct ohash_elem *, void *);
+static bool ksm_less (const struct ohash_elem *, const struct ohash_elem *,
+		void *);
+
+/* Copy-on-write statistics. */
+static size_t cow_shared;            /* Pages shared by fork. */
+static size_t cow_copied;            /* Write faults that copied a frame. */
+static size_t cow_reused;            /* Write faults on a last sharer. */
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -15,7 +174,29 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+	lock_init (&frame_lock);
+	cond_init (&frame_done);
+	list_init (&frame_table);
+	zero_frame.kva = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	list_init (&zero_frame.pages);
+	zero_frame.checksum = ohash_bytes (zero_frame.kva, PGSIZE);
+	if (!ohash_init (&ksm_table, ksm_hash, ksm_less, NULL))
+		PANIC ("vm_init: out of memory");
+	list_init (&suspended);
+	cond_init (&resumed);
+	evict_init ();
+	thread_create ("wsd", PRI_MAX, wsd, NULL);
+
+	free_low = palloc_free_count (PAL_USER) / 64;
+	if (free_low < 2)
+		free_low = 2;
+	else if (free_low > 256)
+		free_low = 256;
+	free_high = free_low * 2;
+	sema_init (&kswapd_wake, 0);
+	thread_create ("kswapd", PRI_MAX, kswapd, NULL);
+	if (ksm_pages_to_scan > 0)
+		thread_create ("ksmd", PRI_DEFAULT, ksmd, NULL);
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -35,7 +216,19 @@ page_get_type (struct page *page) {
 /* Helpers */
 static struct frame *vm_get_victim (void);
 static bool vm_do_claim_page (struct page *page);
+static bool claim_in_frame (struct page *, struct frame *);
 static struct frame *vm_evict_frame (void);
+static size_t vm_get_victims (struct frame **, size_t want);
+static void frame_attach (struct frame *, struct page *);
+static bool frame_detach (struct page *);
+static void frame_free (struct frame *);
+static void ksm_unlist (struct frame *);
+static void load_park (void);
+static void **spt_leaf (struct supplemental_page_table *, const void *va,
+		bool create);
+static bool spt_walk (struct supplemental_page_table *, void **node,
+		int level, uintptr_t base, uintptr_t start, uintptr_t end,
+		spt_action_func *, void *aux, bool prune);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -50,11 +243,34 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 
 	/* Check wheter the upage is already occupied or not. */
 	if (spt_find_page (spt, upage) == NULL) {
-		/* TODO: Create the page, fetch the initialier according to the VM type,
-		 * TODO: and then create "uninit" page struct by calling uninit_new. You
-		 * TODO: should modify the field after calling the uninit_new. */
+		bool (*initializer) (struct page *, enum vm_type, void *);
+		struct page *page;
+
+		switch (VM_TYPE (type)) {
+			case VM_ANON:
+				initializer = anon_initializer;
+				break;
+			case VM_FILE:
+				initializer = file_backed_initializer;
+				break;
+			default:
+				goto err;
+		}
+
+		page = malloc (sizeof *page);
+		if (page == NULL)
+			goto err;
+		uninit_new (page, upage, init, type, aux, initializer);
+		page->writable = writable;
+		page->owner = thread_current ();
+		page->referenced = false;
+		page->ws_sample = 0;
 
-		/* TODO: Insert the page into the spt. */
+		if (!spt_insert_page (spt, page)) {
+			free (page);
+			goto err;
+		}
+		return true;
 	}
 err:
 	return false;
@@ -62,82 +278,1185 @@ err:
 
 /* Find VA from spt and return page. On error, return NULL. */
 struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	uint64_t start = spt_timing ? rdtsc () : 0;
 	struct page *page = NULL;
-	/* TODO: Fill this function. */
+	void **leaf;
 
+	if (is_user_vaddr (va)) {
+		leaf = spt_leaf (spt, va, false);
+		if (leaf != NULL)
+			page = leaf[SPT_IDX (va, 0)];
+	}
+
+	if (spt_timing) {
+		spt_lookups++;
+		spt_lookup_cycles += rdtsc () - start;
+	}
 	return page;
 }
 
 /* Insert PAGE into spt with validation. */
 bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-	/* TODO: Fill this function. */
+spt_insert_page (struct supplemental_page_table *spt, struct page *page) {
+	void **leaf;
+
+	ASSERT (pg_ofs (page->va) == 0);
+
+	if (!is_user_vaddr (page->va))
+		return false;
+	leaf = spt_leaf (spt, page->va, true);
+	if (leaf == NULL || leaf[SPT_IDX (page->va, 0)] != NULL)
+		return false;
 
-	return succ;
+	leaf[SPT_IDX (page->va, 0)] = page;
+	spt->page_cnt++;
+	if (++spt_pages > spt_peak_pages)
+		spt_peak_pages = spt_pages;
+	return true;
 }
 
+/* Remove PAGE from spt and free it. */
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
+	void **leaf = spt_leaf (spt, page->va, false);
+
+	ASSERT (leaf != NULL && leaf[SPT_IDX (page->va, 0)] == page);
+
+	leaf[SPT_IDX (page->va, 0)] = NULL;
+	spt->page_cnt--;
+	spt_pages--;
 	vm_dealloc_page (page);
+}
+
+/* Calls ACTION for each page in SPT whose address is in [START, END),
+ * in order of address.  ACTION may remove the page it is given.  Returns
+ * false if ACTION stopped the walk, true otherwise. */
+bool
+spt_for_each (struct supplemental_page_table *spt, void *start, void *end,
+		spt_action_func *action, void *aux) {
+	if (spt->root == NULL)
+		return true;
+	return spt_walk (spt, spt->root, SPT_LEVELS - 1, 0, (uintptr_t) start,
+			(uintptr_t) end, action, aux, false);
+}
+
+/* spt_for_each() helper for spt_remove_range(). */
+static bool
+remove_page (struct page *page, void *spt) {
+	spt_remove_page (spt, page);
+	return true;
+}
+
+/* Run of adjacent pages being unmapped by spt_remove_range(). */
+struct unmap_run {
+	uint64_t *pml4;        /* Page table to unmap them from. */
+	void *start;           /* First page. */
+	void *end;             /* End of the run so far. */
+};
+
+/* Unmaps the pages of run R, if any, with a single range update. */
+static void
+unmap_run_flush (struct unmap_run *r) {
+	if (r->end != r->start)
+		pml4_unmap_range (r->pml4, r->start,
+				((uint8_t *) r->end - (uint8_t *) r->start) / PGSIZE);
+}
+
+/* spt_for_each() helper for spt_remove_range().  Extends the run in R
+ * over PAGE, unmapping the run so far first if PAGE does not follow
+ * it. */
+static bool
+unmap_run_add (struct page *page, void *r_) {
+	struct unmap_run *r = r_;
+
+	if (page->va != r->end) {
+		unmap_run_flush (r);
+		r->start = page->va;
+	}
+	r->end = page->va + PGSIZE;
 	return true;
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Removes and frees every page in SPT, which must be the current
+ * thread's, whose address is in [START, END), and frees the radix tree
+ * nodes that are left empty.
+ * The pages are unmapped first, a run of adjacent pages at a time, so
+ * that the TLB is flushed once per run instead of once per page;
+ * vm_free_frame() then finds them unmapped already. */
+void
+spt_remove_range (struct supplemental_page_table *spt, void *start,
+		void *end) {
+	struct unmap_run r = { thread_current ()->pml4, NULL, NULL };
+	size_t i;
+
+	if (spt->root == NULL)
+		return;
+	if (r.pml4 != NULL) {
+		spt_for_each (spt, start, end, unmap_run_add, &r);
+		unmap_run_flush (&r);
+	}
+	spt_walk (spt, spt->root, SPT_LEVELS - 1, 0, (uintptr_t) start,
+			(uintptr_t) end, remove_page, spt, true);
+
+	for (i = 0; i < SPT_FANOUT; i++)
+		if (spt->root[i] != NULL)
+			return;
+	palloc_free_page (spt->root);
+	spt->root = NULL;
+	spt->node_cnt--;
+	spt_nodes--;
+}
+
+/* Returns the leaf node of SPT that covers VA.  If there is none and
+ * CREATE is true, creates it, along with any missing nodes above it;
+ * otherwise returns NULL.  Also returns NULL if memory runs out. */
+static void **
+spt_leaf (struct supplemental_page_table *spt, const void *va, bool create) {
+	uintptr_t leaf_va = (uintptr_t) va & ~(SPT_LEAF_SPAN - 1);
+	void ***slot = (void ***) &spt->root;
+	int level;
+
+	if (spt->leaf != NULL && spt->leaf_va == leaf_va)
+		return spt->leaf;
+
+	for (level = SPT_LEVELS - 1; ; level--) {
+		if (*slot == NULL) {
+			if (!create)
+				return NULL;
+			*slot = palloc_get_page (PAL_ZERO);
+			if (*slot == NULL)
+				return NULL;
+			spt->node_cnt++;
+			if (++spt_nodes > spt_peak_nodes)
+				spt_peak_nodes = spt_nodes;
+		}
+		if (level == 0)
+			break;
+		slot = (void ***) &(*slot)[SPT_IDX (va, level)];
+	}
+
+	spt->leaf = *slot;
+	spt->leaf_va = leaf_va;
+	return spt->leaf;
+}
+
+/* Walks the part of SPT's subtree rooted at NODE, which is at LEVEL and
+ * covers addresses from BASE, that lies in [START, END), calling ACTION
+ * for each page.  If PRUNE is true, frees the child nodes left empty. */
+static bool
+spt_walk (struct supplemental_page_table *spt, void **node, int level,
+		uintptr_t base, uintptr_t start, uintptr_t end,
+		spt_action_func *action, void *aux, bool prune) {
+	uintptr_t span = 1UL << SPT_SHIFT (level);
+	size_t i = start > base ? (start - base) / span : 0;
+
+	for (; i < SPT_FANOUT && base + i * span < end; i++) {
+		uintptr_t child_base = base + i * span;
+		void **child = node[i];
+		size_t j;
+
+		if (child == NULL)
+			continue;
+		if (level == 0) {
+			if (!action ((struct page *) child, aux))
+				return false;
+			continue;
+		}
+
+		if (!spt_walk (spt, child, level - 1, child_base, start, end,
+					action, aux, prune))
+			return false;
+		if (!prune)
+			continue;
+
+		for (j = 0; j < SPT_FANOUT; j++)
+			if (child[j] != NULL)
+				break;
+		if (j == SPT_FANOUT) {
+			if (spt->leaf == child)
+				spt->leaf = NULL;
+			node[i] = NULL;
+			palloc_free_page (child);
+			spt->node_cnt--;
+			spt_nodes--;
+		}
+	}
+	return true;
+}
+
+/* Returns true if any page mapped to FRAME has been accessed since the
+ * last call, and clears the accessed bits, including the ones that
+ * ws_sample() saved.  frame_lock must be held. */
+bool
+frame_test_and_clear_accessed (struct frame *frame) {
+	bool accessed = false;
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		uint64_t *pml4 = page->owner->pml4;
+
+		bool used = page->referenced;
+
+		if (pml4 != NULL && pml4_is_accessed (pml4, page->va)) {
+			pml4_set_accessed (pml4, page->va, false);
+			used = true;
+		}
+		page->referenced = false;
+
+		/* A page read sequentially is done with once it has been read
+		 * past, so its accesses earn it no second chance. */
+		if (used && page->advice != MADV_SEQUENTIAL)
+			accessed = true;
+	}
+	return accessed;
+}
+
+/* Returns true if FRAME holds an unmodified file page, which can be
+ * dropped without any I/O.  frame_lock must be held. */
+bool
+frame_is_clean_file (struct frame *frame) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		uint64_t *pml4 = page->owner->pml4;
+
+		if (page_get_type (page) != VM_FILE
+				|| (pml4 != NULL && pml4_is_dirty (pml4, page->va)))
+			return false;
+	}
+	return true;
+}
+
+/* Get the struct frame, that will be evicted.
+ * The eviction policy chooses it.  frame_lock must be held. */
 static struct frame *
 vm_get_victim (void) {
-	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
+	return evict_policy->victim ();
+}
+
+/* Writes out and unmaps every page in the CNT frames in VICTIMS, which
+ * the eviction policy no longer tracks, and leaves them busy and empty.
+ * The pages go to swap in one batch, so that they land in adjacent
+ * slots and are written with as few disk commands as possible.
+ * frame_lock must be held; it is released while the pages are
+ * written. */
+static void
+frame_evict (struct frame **victims, size_t cnt) {
+	struct list_elem *e;
+	size_t i, page_cnt = 0;
+
+	for (i = 0; i < cnt; i++) {
+		struct frame *victim = victims[i];
+
+		victim->busy = true;
+		ksm_unlist (victim);
+		victim->checksum = 0;
+		victim->merged = false;
+		if (frame_is_clean_file (victim))
+			evict_clean++;
+		else
+			evict_dirty++;
+
+		/* Unmap every sharer before writing anything out, so that nobody
+		 * can change the frame under us.  Their faults wait for us in
+		 * frame_wait(). */
+		for (e = list_begin (&victim->pages); e != list_end (&victim->pages);
+				e = list_next (e)) {
+			struct page *page = list_entry (e, struct page, frame_elem);
+			if (page->owner->pml4 != NULL)
+				pml4_clear_page (page->owner->pml4, page->va);
+		}
+		page_cnt += victim->ref_cnt;
+	}
+	lock_release (&frame_lock);
+
+	/* The sharers' pages stay linked to the victims while they are busy,
+	 * so no other thread touches the lists until we are done. */
+	swap_batch_begin (page_cnt);
+	for (i = 0; i < cnt; i++)
+		for (e = list_begin (&victims[i]->pages);
+				e != list_end (&victims[i]->pages); e = list_next (e))
+			if (!swap_out (list_entry (e, struct page, frame_elem)))
+				PANIC ("frame_evict: cannot swap out page");
+	swap_batch_end ();
+
+	lock_acquire (&frame_lock);
+	for (i = 0; i < cnt; i++)
+		while (!list_empty (&victims[i]->pages))
+			frame_detach (list_entry (list_front (&victims[i]->pages),
+						struct page, frame_elem));
+	cond_broadcast (&frame_done, &frame_lock);
+}
+
+/* Returns how many frames to evict at once: an eighth of the frames in
+ * use, between 1 and EVICT_BATCH, so that a small pool is not emptied
+ * by a single batch. */
+static size_t
+evict_batch_size (void) {
+	size_t want = frame_cnt / 8;
 
-	return victim;
+	if (want < 1)
+		want = 1;
+	else if (want > EVICT_BATCH)
+		want = EVICT_BATCH;
+	return want;
 }
 
 /* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+ * Evicts up to evict_batch_size() frames at once and frees all but the
+ * one returned, so that the next few faults find free frames and the
+ * evicted pages share swap writes.
+ * If there is nothing to evict because every frame is busy, waits for
+ * one to stop being busy, or to be freed, and returns NULL so that the
+ * caller can try the page allocator again. */
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
+	struct frame *victims[EVICT_BATCH];
+	size_t i, cnt;
 
-	return NULL;
+	lock_acquire (&frame_lock);
+	cnt = vm_get_victims (victims, evict_batch_size ());
+	if (cnt > 0) {
+		frame_evict (victims, cnt);
+		for (i = 1; i < cnt; i++)
+			frame_free (victims[i]);
+	} else if (palloc_free_count (PAL_USER) == 0) {
+		if (frame_cnt == 0)
+			PANIC ("vm_get_frame: out of user memory");
+		cond_wait (&frame_done, &frame_lock);
+	}
+	lock_release (&frame_lock);
+	return cnt > 0 ? victims[0] : NULL;
+}
+
+/* Returns a new busy frame for the user page at KVA and adds it to the
+ * frame table. */
+static struct frame *
+frame_create (void *kva) {
+	struct frame *frame = malloc (sizeof *frame);
+
+	if (frame == NULL)
+		PANIC ("vm_get_frame: out of kernel memory");
+	frame->kva = kva;
+	frame->page = NULL;
+	list_init (&frame->pages);
+	frame->ref_cnt = 0;
+	frame->checksum = 0;
+	frame->ksm_listed = false;
+	frame->merged = false;
+	frame->busy = true;
+
+	lock_acquire (&frame_lock);
+	list_push_back (&frame_table, &frame->table_elem);
+	frame_cnt++;
+	lock_release (&frame_lock);
+	return frame;
+}
+
+/* Chooses up to WANT frames, at most EVICT_BATCH, to evict, and stores
+ * them in VICTIMS.  Returns the number chosen.  frame_lock must be
+ * held. */
+static size_t
+vm_get_victims (struct frame **victims, size_t want) {
+	size_t cnt;
+
+	ASSERT (want <= EVICT_BATCH);
+	for (cnt = 0; cnt < want; cnt++) {
+		victims[cnt] = vm_get_victim ();
+		if (victims[cnt] == NULL)
+			break;
+	}
+	return cnt;
+}
+
+/* Wakes kswapd if free user frames are below the low watermark. */
+static void
+kswapd_poke (void) {
+	if (!kswapd_awake && palloc_free_count (PAL_USER) < free_low) {
+		kswapd_awake = true;
+		sema_up (&kswapd_wake);
+	}
+}
+
+/* Background reclaim thread.  Evicts and frees frames, a batch at a
+ * time, until the high watermark is reached.  Stops early if swap is
+ * running out, leaving the rest to faults. */
+static void
+kswapd (void *aux UNUSED) {
+	struct frame *victims[EVICT_BATCH];
+	size_t i, cnt;
+
+	for (;;) {
+		sema_down (&kswapd_wake);
+		kswapd_wakeups++;
+		while (palloc_free_count (PAL_USER) < free_high
+				&& swap_available () >= EVICT_BATCH) {
+			lock_acquire (&frame_lock);
+			cnt = vm_get_victims (victims, evict_batch_size ());
+			if (cnt > 0) {
+				frame_evict (victims, cnt);
+				for (i = 0; i < cnt; i++)
+					frame_free (victims[i]);
+				cond_broadcast (&frame_done, &frame_lock);
+			}
+			lock_release (&frame_lock);
+			if (cnt == 0)
+				break;
+			kswapd_reclaimed += cnt;
+		}
+		kswapd_awake = false;
+	}
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
  * and return it. This always return valid address. That is, if the user pool
  * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * space.
+ * If ZERO is true, the frame is filled with zeros; otherwise it may
+ * still hold a previous owner's data.
+ * The frame is returned busy, so that it cannot be evicted before the
+ * caller has filled it in and called frame_install(). */
 static struct frame *
-vm_get_frame (void) {
+vm_get_frame (bool zero) {
+	enum palloc_flags flags = PAL_USER | (zero ? PAL_ZERO : 0);
 	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
+	void *kva;
+
+	kswapd_poke ();
+	while ((kva = palloc_get_page (flags)) == NULL) {
+		direct_reclaims++;
+		frame = vm_evict_frame ();
+		if (frame != NULL)
+			break;
+	}
+	if (frame == NULL)
+		frame = frame_create (kva);
+	else if (zero)
+		memset (frame->kva, 0, PGSIZE);
+	ASSERT (frame->busy);
+	frame->page = NULL;
 
 	ASSERT (frame != NULL);
 	ASSERT (frame->page == NULL);
 	return frame;
 }
 
+/* Wakes up threads waiting for FRAME to stop being busy.  frame_lock
+ * must be held. */
+static void
+frame_unbusy (struct frame *frame) {
+	frame->busy = false;
+	cond_broadcast (&frame_done, &frame_lock);
+}
+
+/* Hands FRAME, returned busy by vm_get_frame() and now filled in, to the
+ * eviction policy.  frame_lock must be held. */
+static void
+frame_install (struct frame *frame) {
+	evict_policy->insert (frame);
+	frame_unbusy (frame);
+}
+
+/* Waits until PAGE's frame, if any, is neither being set up nor
+ * evicted.  frame_lock must be held. */
+static void
+frame_wait (struct page *page) {
+	while (page->frame != NULL && page->frame->busy)
+		cond_wait (&frame_done, &frame_lock);
+}
+
 /* Growing the stack. */
 static void
 vm_stack_growth (void *addr UNUSED) {
 }
 
-/* Handle the fault on write_protected page */
+/* Adds PAGE to the sharers of FRAME.  The caller must hold frame_lock
+ * or own both exclusively. */
+static void
+frame_attach (struct frame *frame, struct page *page) {
+	if (frame->ref_cnt++ == 0)
+		frame->page = page;
+	list_push_back (&frame->pages, &page->frame_elem);
+	page->frame = frame;
+}
+
+/* Removes PAGE from the sharers of its frame and returns true if that
+ * was the last one.  The caller must hold frame_lock. */
+static bool
+frame_detach (struct page *page) {
+	struct frame *frame = page->frame;
+
+	list_remove (&page->frame_elem);
+	page->frame = NULL;
+	if (--frame->ref_cnt == 0) {
+		frame->page = NULL;
+		return true;
+	}
+	if (frame->page == page)
+		frame->page = list_entry (list_front (&frame->pages), struct page,
+				frame_elem);
+	return false;
+}
+
+/* Removes FRAME, which no page uses and the eviction policy no longer
+ * tracks, from the frame table and frees it.  frame_lock must be held. */
+static void
+frame_free (struct frame *frame) {
+	ksm_unlist (frame);
+	list_remove (&frame->table_elem);
+	frame_cnt--;
+	palloc_free_page (frame->kva);
+	free (frame);
+}
+
+/* Handle the fault on write_protected page.
+ * frame_lock must be held and PAGE must be resident. */
+static bool
+vm_handle_wp (struct page *page) {
+	uint64_t *pml4 = page->owner->pml4;
+	struct frame *old = page->frame;
+	struct frame *new;
+	bool success;
+
+	if (!page->writable)
+		return false;
+
+	/* The zero frame is never written, not even by its last sharer. */
+	if (old == &zero_frame) {
+		lock_release (&frame_lock);
+		new = vm_get_frame (true);
+		lock_acquire (&frame_lock);
+
+		frame_detach (page);
+		frame_attach (new, page);
+		success = pml4_set_page (pml4, page->va, new->kva, true);
+		frame_install (new);
+		zero_copied++;
+		return success;
+	}
+
+	/* The last sharer takes the frame over. */
+	if (old->ref_cnt == 1) {
+		cow_reused++;
+		return pml4_set_page (pml4, page->va, old->kva, true);
+	}
+
+	/* Copy outside the lock.  Keeping OLD busy stops it from being
+	 * evicted meanwhile; the other sharers may still go away. */
+	old->busy = true;
+	lock_release (&frame_lock);
+	new = vm_get_frame (false);
+	memcpy (new->kva, old->kva, PGSIZE);
+	lock_acquire (&frame_lock);
+
+	frame_detach (page);
+	frame_attach (new, page);
+	success = pml4_set_page (pml4, page->va, new->kva, true);
+	frame_install (new);
+	frame_unbusy (old);
+	if (old->ref_cnt == 1)
+		cow_reused++;
+	cow_copied++;
+	return success;
+}
+
+/* Returns true if PAGE's contents, once it is claimed, will come from a
+ * file: a file-backed page, or an uninit page with a loader such as an
+ * executable segment's. */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+page_from_file (struct page *page) {
+	if (VM_TYPE (page->operations->type) == VM_UNINIT)
+		return (page->uninit.init != NULL
+				|| VM_TYPE (page->uninit.type) == VM_FILE);
+	return VM_TYPE (page->operations->type) == VM_FILE;
+}
+
+/* Returns true if PAGE has never been brought in and would be brought in
+ * as zeros. */
+static bool
+page_zero_fill (struct page *page) {
+	return (VM_TYPE (page->operations->type) == VM_UNINIT
+			&& VM_TYPE (page->uninit.type) == VM_ANON
+			&& page->uninit.init == NULL);
+}
+
+/* Brings PAGE, for which page_zero_fill() is true, in by mapping the
+ * zero frame read-only.  frame_lock must be held. */
+static bool
+map_zero_frame (struct page *page) {
+	/* Turns PAGE into an anonymous page.  The kva is not written. */
+	if (!swap_in (page, zero_frame.kva))
+		return false;
+	frame_attach (&zero_frame, page);
+	zero_maps++;
+	return pml4_set_page (page->owner->pml4, page->va, zero_frame.kva, false);
+}
+
+/* PAGE was just brought in from its file by a fault.  Brings in the
+ * pages after it that also come from a file and have the same access,
+ * up to the current thread's window, but only into free frames: fault-
+ * around never evicts.  Pages that are resident already are passed
+ * over. */
+static void
+fault_around (struct page *page) {
+	struct thread *t = thread_current ();
+	unsigned i;
+
+	around_faults++;
+	if (page->advice == MADV_SEQUENTIAL)
+		t->fault_window = FAULT_AROUND_MAX;
+	else if (page->va == t->fault_next) {
+		around_sequential++;
+		t->fault_window = (t->fault_window * 2 < FAULT_AROUND_MAX
+				? t->fault_window * 2 : FAULT_AROUND_MAX);
+	} else
+		t->fault_window = FAULT_AROUND_MIN;
+
+	for (i = 1; i < t->fault_window; i++) {
+		void *va = page->va + i * PGSIZE;
+		struct page *next;
+		bool resident;
+		void *kva;
+
+		if (!is_user_vaddr (va))
+			break;
+		next = spt_find_page (&t->spt, va);
+		if (next == NULL || next->writable != page->writable
+				|| !page_from_file (next))
+			break;
+
+		lock_acquire (&frame_lock);
+		resident = next->frame != NULL;
+		lock_release (&frame_lock);
+		if (resident)
+			continue;
+
+		/* Leave the last free frames to faults. */
+		if (palloc_free_count (PAL_USER) <= free_low)
+			break;
+		kva = palloc_get_page (PAL_USER);
+		if (kva == NULL || !claim_in_frame (next, frame_create (kva)))
+			break;
+		around_pages++;
+	}
+	t->fault_next = page->va + i * PGSIZE;
 }
 
 /* Return true on success */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
-	struct page *page = NULL;
-	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
+vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr,
+		bool user, bool write, bool not_present) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct page *page;
+	bool success;
 
-	return vm_do_claim_page (page);
+	if (addr == NULL || !is_user_vaddr (addr))
+		return false;
+
+	/* Only park in user mode, where we hold no kernel locks. */
+	if (user && thread_current ()->suspended)
+		load_park ();
+
+	page = spt_find_page (spt, pg_round_down (addr));
+	if (page == NULL || (write && !page->writable))
+		return false;
+
+	lock_acquire (&frame_lock);
+	frame_wait (page);
+	if (page->frame == NULL) {
+		bool around;
+
+		/* A read of a page that was never written reads zeros. */
+		if (!write && page_zero_fill (page)) {
+			success = map_zero_frame (page);
+			lock_release (&frame_lock);
+			return success;
+		}
+
+		/* Ask before claiming, which may turn an uninit page into an
+		 * anonymous one. */
+		around = page_from_file (page) && page->advice != MADV_RANDOM;
+
+		lock_release (&frame_lock);
+		if (!vm_do_claim_page (page))
+			return false;
+		if (around)
+			fault_around (page);
+		return true;
+	}
+
+	/* Resident.  A write to a read-only mapping is copy-on-write; any
+	 * other fault raced with a mapping change and can be retried. */
+	success = not_present || !write || vm_handle_wp (page);
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Samples the accessed bits of every resident page, moving them into
+ * the pages' REFERENCED bits so that the eviction policy still sees
+ * them, and recomputes the working set of every process with resident
+ * pages.  Those processes are put on PROCS.  Returns their combined
+ * working set.  frame_lock must be held. */
+static size_t
+ws_sample (struct list *procs) {
+	struct list_elem *e, *p;
+	size_t total = 0;
+
+	ws_epoch++;
+	list_init (procs);
+	for (e = list_begin (&frame_table); e != list_end (&frame_table);
+			e = list_next (e)) {
+		struct frame *frame = list_entry (e, struct frame, table_elem);
+
+		/* A busy frame's pages are changing under us. */
+		if (frame->busy)
+			continue;
+		for (p = list_begin (&frame->pages); p != list_end (&frame->pages);
+				p = list_next (p)) {
+			struct page *page = list_entry (p, struct page, frame_elem);
+			struct thread *t = page->owner;
+
+			if (t->ws_epoch != ws_epoch) {
+				t->ws_epoch = ws_epoch;
+				t->ws_size = 0;
+				list_push_back (procs, &t->ws_elem);
+			}
+			if (t->pml4 != NULL && pml4_is_accessed (t->pml4, page->va)) {
+				pml4_set_accessed (t->pml4, page->va, false);
+				page->referenced = true;
+				page->ws_sample = ws_epoch;
+			}
+			if (ws_epoch - page->ws_sample < WS_WINDOW) {
+				t->ws_size++;
+				total++;
+			}
+		}
+	}
+	return total;
+}
+
+/* Suspends or resumes a process, given the processes with resident
+ * pages on PROCS and the FAULTS and EVICTIONS during the last sample.
+ * Waits WS_WINDOW samples after each change for the effect to show.
+ * frame_lock must be held. */
+static void
+load_control (struct list *procs, size_t faults, size_t evictions) {
+	struct thread *victim = NULL;
+	size_t running = 0;
+	struct list_elem *e;
+
+	if (ws_epoch - load_changed < WS_WINDOW)
+		return;
+
+	/* Never suspend the last running process.  Among the others, pick
+	 * the lowest priority, then the largest working set. */
+	for (e = list_begin (procs); e != list_end (procs); e = list_next (e)) {
+		struct thread *t = list_entry (e, struct thread, ws_elem);
+
+		if (t->suspended)
+			continue;
+		running++;
+		if (victim == NULL || t->priority < victim->priority
+				|| (t->priority == victim->priority
+					&& t->ws_size > victim->ws_size))
+			victim = t;
+	}
+
+	if (faults >= LOAD_FAULTS_HIGH && evictions > 0 && running > 1) {
+		victim->suspended = true;
+		list_push_back (&suspended, &victim->suspend_elem);
+		load_suspends++;
+		load_changed = ws_epoch;
+	} else if (!list_empty (&suspended)
+			&& (faults <= LOAD_FAULTS_LOW || running == 0)) {
+		struct thread *t = list_entry (list_pop_front (&suspended),
+				struct thread, suspend_elem);
+		t->suspended = false;
+		cond_broadcast (&resumed, &frame_lock);
+		load_resumes++;
+		load_changed = ws_epoch;
+	}
+}
+
+/* Working-set daemon: samples the working sets and runs load control
+ * every WS_INTERVAL ticks. */
+static void
+wsd (void *aux UNUSED) {
+	size_t last_faults = 0, last_evictions = 0;
+
+	for (;;) {
+		struct list procs;
+		size_t total, evictions;
+
+		timer_sleep (WS_INTERVAL);
+
+		lock_acquire (&frame_lock);
+		total = ws_sample (&procs);
+		if (total > ws_peak)
+			ws_peak = total;
+		evictions = evict_clean + evict_dirty;
+		load_control (&procs, page_ins - last_faults,
+				evictions - last_evictions);
+		last_faults = page_ins;
+		last_evictions = evictions;
+		lock_release (&frame_lock);
+	}
+}
+
+/* spt_for_each() helper for load_park().  Swaps out PAGE if it has a
+ * frame of its own. */
+static bool
+park_page (struct page *page, void *aux UNUSED) {
+	struct frame *frame;
+
+	lock_acquire (&frame_lock);
+	frame_wait (page);
+	frame = page->frame;
+	if (frame != NULL && frame->ref_cnt == 1 && frame != &zero_frame) {
+		evict_policy->remove (frame);
+		frame_evict (&frame, 1);
+		frame_free (frame);
+		load_swapped++;
+	}
+	lock_release (&frame_lock);
+	return true;
+}
+
+/* Gives up the current process's frames, which load control wants for
+ * other processes, and waits until it is resumed. */
+static void
+load_park (void) {
+	struct thread *t = thread_current ();
+
+	spt_for_each (&t->spt, NULL, (void *) KERN_BASE, park_page, NULL);
+	lock_acquire (&frame_lock);
+	while (t->suspended)
+		cond_wait (&resumed, &frame_lock);
+	lock_release (&frame_lock);
+}
+
+/* Removes FRAME from the KSM table, if it is there.  frame_lock must be
+ * held. */
+static void
+ksm_unlist (struct frame *frame) {
+	if (frame->ksm_listed) {
+		ohash_delete (&ksm_table, &frame->ksm_elem);
+		frame->ksm_listed = false;
+	}
+}
+
+/* ohash_clear() helper for ksm_scan(). */
+static void
+ksm_unlisted (struct ohash_elem *e, void *aux UNUSED) {
+	ohash_entry (e, struct frame, ksm_elem)->ksm_listed = false;
+}
+
+/* Returns true if FRAME holds anonymous pages only. */
+static bool
+frame_is_anon (struct frame *frame) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		if (VM_TYPE (page->operations->type) != VM_ANON)
+			return false;
+	}
+	return !list_empty (&frame->pages);
+}
+
+/* Takes write access to FRAME away from every page mapped to it. */
+static void
+frame_protect (struct frame *frame) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		uint64_t *pml4 = page->owner->pml4;
+
+		if (pml4 != NULL && pml4_get_page (pml4, page->va) == frame->kva)
+			pml4_protect_range (pml4, page->va, 1, false);
+	}
+}
+
+/* Moves the pages of DUP to KEEP, read-only, and frees DUP, if the two
+ * hold the same contents.  Both lose write access either way, so that
+ * the comparison stays true.  Returns true if they were merged.
+ * frame_lock must be held. */
+static bool
+ksm_merge (struct frame *keep, struct frame *dup) {
+	if (keep->busy)
+		return false;
+	frame_protect (keep);
+	frame_protect (dup);
+	if (memcmp (keep->kva, dup->kva, PGSIZE))
+		return false;
+
+	while (!list_empty (&dup->pages)) {
+		struct page *page = list_entry (list_front (&dup->pages),
+				struct page, frame_elem);
+		uint64_t *pml4 = page->owner->pml4;
+
+		frame_detach (page);
+		frame_attach (keep, page);
+		if (pml4 != NULL && pml4_get_page (pml4, page->va) == dup->kva)
+			pml4_set_page (pml4, page->va, keep->kva, false);
+	}
+	evict_policy->remove (dup);
+	frame_free (dup);
+
+	ksm_merges++;
+	if (keep == &zero_frame)
+		ksm_zero_merges++;
+	else
+		keep->merged = true;
+	return true;
+}
+
+/* Hashes FRAME and, if its contents did not change since it was last
+ * scanned, merges it with a frame of the same contents or enters it in
+ * the KSM table.  FRAME may be freed.  frame_lock must be held. */
+static void
+ksm_scan_frame (struct frame *frame) {
+	uint64_t checksum;
+	struct ohash_elem *e;
+
+	if (frame->busy || frame->ksm_listed || !frame_is_anon (frame))
+		return;
+	checksum = ohash_bytes (frame->kva, PGSIZE);
+	if (checksum != frame->checksum) {
+		frame->checksum = checksum;
+		return;
+	}
+
+	if (checksum == zero_frame.checksum && ksm_merge (&zero_frame, frame))
+		return;
+	e = ohash_find (&ksm_table, &frame->ksm_elem);
+	if (e != NULL) {
+		struct frame *twin = ohash_entry (e, struct frame, ksm_elem);
+		if (ksm_merge (twin, frame))
+			return;
+
+		/* TWIN changed, or only its hash matched: FRAME takes its
+		 * place. */
+		ksm_unlist (twin);
+	}
+	ohash_insert (&ksm_table, &frame->ksm_elem);
+	frame->ksm_listed = true;
+}
+
+/* Scans the next ksm_pages_to_scan frames of the frame table. */
+static void
+ksm_scan (void) {
+	size_t i;
+
+	lock_acquire (&frame_lock);
+	for (i = 0; i < ksm_pages_to_scan && !list_empty (&frame_table); i++) {
+		struct frame *frame = list_entry (list_pop_front (&frame_table),
+				struct frame, table_elem);
+
+		/* Rotate the table, so that the next scan goes on from here. */
+		list_push_back (&frame_table, &frame->table_elem);
+		ksm_scan_frame (frame);
+		ksm_scanned++;
+
+		if (++ksm_sweep_pos >= frame_cnt) {
+			ohash_clear (&ksm_table, ksm_unlisted);
+			ksm_sweep_pos = 0;
+			ksm_sweeps++;
+		}
+	}
+	lock_release (&frame_lock);
+}
+
+/* Same-page merging thread. */
+static void
+ksmd (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (KSM_INTERVAL);
+		ksm_scan ();
+	}
+}
+
+/* Returns the hash value of the frame holding KSM table element E. */
+static uint64_t
+ksm_hash (const struct ohash_elem *e, void *aux UNUSED) {
+	return ohash_entry (e, struct frame, ksm_elem)->checksum;
+}
+
+/* Orders the frames holding KSM table elements A and B by contents
+ * hash. */
+static bool
+ksm_less (const struct ohash_elem *a, const struct ohash_elem *b,
+		void *aux UNUSED) {
+	return (ohash_entry (a, struct frame, ksm_elem)->checksum
+			< ohash_entry (b, struct frame, ksm_elem)->checksum);
+}
+
+/* Returns true if PAGE has a frame, waiting for it if it is busy. */
+static bool
+page_resident (struct page *page) {
+	bool resident;
+
+	lock_acquire (&frame_lock);
+	frame_wait (page);
+	resident = page->frame != NULL;
+	lock_release (&frame_lock);
+	return resident;
+}
+
+/* Returns true if every page in [ADDR, ADDR + LENGTH) is in the current
+ * process's address space.  ADDR must be page-aligned. */
+static bool
+range_mapped (void *addr, size_t length) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	void *va;
+
+	if (pg_ofs (addr) != 0 || addr == NULL || length == 0
+			|| !is_user_vaddr (addr) || !is_user_vaddr (addr + length - 1)
+			|| addr + length < addr)
+		return false;
+	for (va = addr; va < addr + length; va += PGSIZE)
+		if (spt_find_page (spt, va) == NULL)
+			return false;
+	return true;
+}
+
+/* Throws away PAGE's contents.  An anonymous page starts over as an
+ * untouched page, reading as zeros.  A file page is written back, if
+ * it has a frame of its own, and reread when next used. */
+static void
+page_drop (struct page *page) {
+	bool writable = page->writable;
+	struct thread *owner = page->owner;
+	int advice = page->advice;
+	void *mapping = page->mapping;
+
+	if (VM_TYPE (page->operations->type) == VM_FILE) {
+		park_page (page, NULL);
+		return;
+	}
+	if (VM_TYPE (page->operations->type) != VM_ANON)
+		return;
+
+	destroy (page);
+	uninit_new (page, page->va, NULL, VM_ANON, NULL, anon_initializer);
+	page->writable = writable;
+	page->owner = owner;
+	page->advice = advice;
+	page->mapping = mapping;
+	advise_dropped++;
+}
+
+/* Takes ADVICE, one of the MADV_* values, about the current process's
+ * use of the LENGTH bytes at ADDR, which must be page-aligned and
+ * mapped.  Returns true if successful.
+ *
+ * MADV_WILLNEED reads the pages in before returning, not in the
+ * background: a kernel thread could not safely claim pages of a process
+ * that may unmap them or exit meanwhile.  It only uses free frames
+ * above the low watermark, so it never evicts on a guess, and it stops
+ * early rather than fail once they run out. */
+bool
+vm_madvise (void *addr, size_t length, int advice) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	void *va, *kva;
+
+	length = ROUND_UP (length, PGSIZE);
+	if (!range_mapped (addr, length))
+		return false;
+
+	for (va = addr; va < addr + length; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, va);
+
+		switch (advice) {
+			case MADV_NORMAL:
+			case MADV_RANDOM:
+			case MADV_SEQUENTIAL:
+				page->advice = advice;
+				break;
+			case MADV_WILLNEED:
+				if (page_resident (page))
+					break;
+				if (palloc_free_count (PAL_USER) <= free_low)
+					return true;
+				kva = palloc_get_page (PAL_USER
+						| (page_zero_fill (page) ? PAL_ZERO : 0));
+				if (kva == NULL || !claim_in_frame (page, frame_create (kva)))
+					return true;
+				advise_prefetched++;
+				break;
+			case MADV_DONTNEED:
+				page_drop (page);
+				break;
+			default:
+				return false;
+		}
+	}
+	return true;
+}
+
+/* Brings every page of the current process in [ADDR, ADDR + LENGTH)
+ * into memory, evicting other pages if necessary, so that the range can
+ * be used without faulting.  Pages are read in address order, which lets
+ * swap read-ahead cover runs of swapped-out pages.  Returns false if
+ * some page could not be read in or the range is not mapped. */
+bool
+vm_populate (void *addr, size_t length) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	void *va;
+
+	length = ROUND_UP (length, PGSIZE);
+	if (!range_mapped (addr, length))
+		return false;
+	for (va = addr; va < addr + length; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, va);
+
+		if (!page_resident (page)) {
+			if (!vm_do_claim_page (page))
+				return false;
+			populated++;
+		}
+	}
+	return true;
+}
+
+/* Maps LENGTH bytes of zeroed anonymous memory at ADDR, which must be
+ * page-aligned and not overlap any page that is mapped already.  FLAGS
+ * is mmap()'s WRITABLE argument: its lowest bit makes the memory
+ * writable, and MAP_POPULATE brings it in at once.  Returns ADDR, or a
+ * null pointer on failure. */
+void *
+vm_mmap_anon (void *addr, size_t length, int flags) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	void *va, *end;
+
+	if (addr == NULL || pg_ofs (addr) != 0 || length == 0
+			|| length > (size_t) KERN_BASE)
+		return NULL;
+	end = addr + ROUND_UP (length, PGSIZE);
+	if (end < addr || !is_user_vaddr (end - 1))
+		return NULL;
+	for (va = addr; va < end; va += PGSIZE)
+		if (spt_find_page (spt, va) != NULL)
+			return NULL;
+
+	for (va = addr; va < end; va += PGSIZE) {
+		if (!vm_alloc_page (VM_ANON, va, flags & 1)) {
+			spt_remove_range (spt, addr, va);
+			return NULL;
+		}
+		spt_find_page (spt, va)->mapping = addr;
+	}
+	if (flags & MAP_POPULATE)
+		vm_populate (addr, end - addr);
+	return addr;
 }
 
 /* Free the page.
@@ -150,41 +1469,254 @@ vm_dealloc_page (struct page *page) {
 
 /* Claim the page that allocate on VA. */
 bool
-vm_claim_page (void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function */
+vm_claim_page (void *va) {
+	struct page *page = spt_find_page (&thread_current ()->spt, va);
 
-	return vm_do_claim_page (page);
+	return page != NULL && vm_do_claim_page (page);
 }
 
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+	page_ins++;
+	return claim_in_frame (page, vm_get_frame (page_zero_fill (page)));
+}
+
+/* Brings PAGE into FRAME, which must be busy and empty, and maps it.
+ * Frees FRAME on failure. */
+static bool
+claim_in_frame (struct page *page, struct frame *frame) {
+	bool success;
 
 	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+	lock_acquire (&frame_lock);
+	frame_attach (frame, page);
+	lock_release (&frame_lock);
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
+	success = (swap_in (page, frame->kva)
+			&& pml4_set_page (page->owner->pml4, page->va, frame->kva,
+				page->writable));
 
-	return swap_in (page, frame->kva);
+	lock_acquire (&frame_lock);
+	frame_install (frame);
+	lock_release (&frame_lock);
+	if (!success)
+		vm_free_frame (page);
+	return success;
+}
+
+/* Unmaps PAGE from its owner's address space, unless that was done
+ * already, and releases its frame, freeing the frame if no other page
+ * shares it. */
+void
+vm_free_frame (struct page *page) {
+	uint64_t *pml4 = page->owner->pml4;
+	struct frame *frame;
+
+	lock_acquire (&frame_lock);
+	frame_wait (page);
+	if (evict_policy->forget != NULL)
+		evict_policy->forget (page);
+	frame = page->frame;
+	if (frame != NULL) {
+		if (pml4 != NULL && pml4_get_page (pml4, page->va) == frame->kva)
+			pml4_clear_page (pml4, page->va);
+		if (frame_detach (page) && frame != &zero_frame) {
+			evict_policy->remove (frame);
+			frame_free (frame);
+		}
+	}
+	lock_release (&frame_lock);
 }
 
 /* Initialize new supplemental page table */
 void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	spt->root = NULL;
+	spt->page_cnt = 0;
+	spt->node_cnt = 0;
+	spt->leaf = NULL;
+	spt->leaf_va = 0;
+}
+
+/* State of supplemental_page_table_copy(). */
+struct fork_copy {
+	struct supplemental_page_table *dst;  /* Child's table. */
+	uint64_t *parent_pml4;  /* Parent's page table. */
+	void *ro_start;         /* Parent pages still to be write-protected... */
+	size_t ro_cnt;          /* ...and how many, in one contiguous run. */
+};
+
+/* Write-protects the run of parent pages collected in FC. */
+static void
+flush_protect (struct fork_copy *fc) {
+	if (fc->ro_cnt > 0)
+		pml4_protect_range (fc->parent_pml4, fc->ro_start, fc->ro_cnt, false);
+	fc->ro_cnt = 0;
+}
+
+/* spt_for_each() helper for supplemental_page_table_copy().  Copies PAGE
+ * into the current process's table.  Pages that were never faulted in
+ * stay lazy and share the parent's initializer and AUX.  Resident pages
+ * share the parent's frame read-only until one side writes to it. */
+static bool
+copy_page (struct page *page, void *fc_) {
+	struct fork_copy *fc = fc_;
+	struct page *child;
+	bool success;
+
+	if (VM_TYPE (page->operations->type) == VM_UNINIT) {
+		if (!vm_alloc_page_with_initializer (page->uninit.type, page->va,
+					page->writable, page->uninit.init, page->uninit.aux))
+			return false;
+		child = spt_find_page (fc->dst, page->va);
+		child->advice = page->advice;
+		child->mapping = page->mapping;
+		return true;
+	}
+
+	child = malloc (sizeof *child);
+	if (child == NULL)
+		return false;
+
+	/* Bring an evicted page back, so that the child can share it.  The
+	 * copy is taken while the frame is held, so that it cannot pick up
+	 * swap state that the parent's page is about to drop. */
+	lock_acquire (&frame_lock);
+	for (;;) {
+		frame_wait (page);
+		if (page->frame != NULL)
+			break;
+		lock_release (&frame_lock);
+		if (!vm_do_claim_page (page)) {
+			free (child);
+			return false;
+		}
+		lock_acquire (&frame_lock);
+	}
+	*child = *page;
+	child->owner = thread_current ();
+	child->frame = NULL;
+	if (!spt_insert_page (fc->dst, child)) {
+		lock_release (&frame_lock);
+		free (child);
+		return false;
+	}
+	frame_attach (page->frame, child);
+	success = pml4_set_page (child->owner->pml4, child->va, child->frame->kva,
+			false);
+	lock_release (&frame_lock);
+	if (!success)
+		return false;
+	cow_shared++;
+
+	/* The parent loses write access too, but only after the walk, in as
+	 * few TLB flushes as possible. */
+	fc->parent_pml4 = page->owner->pml4;
+	if (page->writable) {
+		if (fc->ro_cnt > 0 && page->va != fc->ro_start + fc->ro_cnt * PGSIZE)
+			flush_protect (fc);
+		if (fc->ro_cnt++ == 0)
+			fc->ro_start = page->va;
+	}
+	return true;
 }
 
 /* Copy supplemental page table from src to dst */
 bool
-supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
+supplemental_page_table_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	struct fork_copy fc;
+	bool success;
+
+	ASSERT (dst == &thread_current ()->spt);
+
+	fc.dst = dst;
+	fc.parent_pml4 = NULL;
+	fc.ro_cnt = 0;
+	success = spt_for_each (src, NULL, (void *) KERN_BASE, copy_page, &fc);
+	flush_protect (&fc);
+	return success;
 }
 
 /* Free the resource hold by the supplemental page table */
 void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	struct thread *t = thread_current ();
+
+	/* A process leaving or replacing its address space is not worth
+	 * suspending any more. */
+	lock_acquire (&frame_lock);
+	if (t->suspended) {
+		list_remove (&t->suspend_elem);
+		t->suspended = false;
+	}
+	lock_release (&frame_lock);
+
+	spt_remove_range (spt, NULL, (void *) KERN_BASE);
+	ASSERT (spt->root == NULL && spt->page_cnt == 0);
+}
+
+/* Prints KSM statistics. */
+static void
+ksm_print_stats (void) {
+	struct list_elem *e;
+	size_t shared = 0, sharing = 0;
+
+	lock_acquire (&frame_lock);
+	for (e = list_begin (&frame_table); e != list_end (&frame_table);
+			e = list_next (e)) {
+		struct frame *frame = list_entry (e, struct frame, table_elem);
+		if (frame->merged && frame->ref_cnt > 1) {
+			shared++;
+			sharing += frame->ref_cnt - 1;
+		}
+	}
+	lock_release (&frame_lock);
+
+	printf ("KSM: %zu frames shared by %zu more pages, %zu merges (%zu into "
+			"the zero frame), %zu frames scanned in %zu sweeps, "
+			"%zu per scan\n",
+			shared, sharing, ksm_merges, ksm_zero_merges, ksm_scanned,
+			ksm_sweeps, ksm_pages_to_scan);
+}
+
+/* Prints supplemental page table statistics. */
+void
+vm_print_stats (void) {
+	size_t pages = spt_peak_pages > 0 ? spt_peak_pages : 1;
+
+	printf ("SPT: %zu pages in %zu nodes (peak %zu pages in %zu nodes, "
+			"%zu bytes of nodes per page)\n",
+			spt_pages, spt_nodes, spt_peak_pages, spt_peak_nodes,
+			spt_peak_nodes * PGSIZE / pages);
+	if (spt_timing)
+		printf ("SPT: %llu lookups, %llu cycles each\n", spt_lookups,
+				spt_lookups > 0 ? spt_lookup_cycles / spt_lookups : 0);
+	printf ("COW: %zu pages shared by fork, %zu copied on write, "
+			"%zu reused by the last sharer\n",
+			cow_shared, cow_copied, cow_reused);
+	printf ("Evict: %s policy, %zu frames in use, %zu page faults, "
+			"%zu evictions (%zu clean file pages, %zu dirty or anonymous)\n",
+			evict_policy->name, frame_cnt, page_ins,
+			evict_clean + evict_dirty, evict_clean, evict_dirty);
+	evict_print_stats ();
+	swap_print_stats ();
+	printf ("Zero frame: %zu read faults mapped it, %zu pages share it, "
+			"%zu left it on write\n",
+			zero_maps, zero_frame.ref_cnt, zero_copied);
+	printf ("Kswapd: %zu wakeups, %zu frames freed in the background, "
+			"%zu faults evicted directly, watermarks %zu and %zu frames\n",
+			kswapd_wakeups, kswapd_reclaimed, direct_reclaims,
+			free_low, free_high);
+	ksm_print_stats ();
+	printf ("Advice: %zu pages read in for WILLNEED, %zu dropped for "
+			"DONTNEED, %zu populated\n",
+			advise_prefetched, advise_dropped, populated);
+	printf ("Fault-around: %zu faults mapped %zu more pages, %zu of the "
+			"faults sequential\n",
+			around_faults, around_pages, around_sequential);
+	printf ("Load: peak working set %zu pages, %zu processes suspended, "
+			"%zu resumed, %zu frames given up\n",
+			ws_peak, load_suspends, load_resumes, load_swapped);
 }
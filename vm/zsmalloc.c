@@ -0,0 +1,164 @@
+/* zsmalloc.c: Allocator for compressed pages.
+ *
+ * Compressed pages come in every size up to ZS_MAX_SIZE, and packing
+ * them densely is the whole point of compressing them.  As in Linux's
+ * zsmalloc, objects are rounded up to a size class, every ZS_ALIGN
+ * bytes, and each class carves its objects out of zspages: runs of 1
+ * to ZS_MAX_PAGES contiguous pages, as many as waste the least space
+ * at the end.  A 1,600-byte class, for example, fits 5 objects in 2
+ * pages with 192 bytes left over, where 1 page would waste 896.
+ *
+ * The free objects of a zspage are linked through their first bytes.
+ * A class keeps its zspages with free objects on a list; a zspage is
+ * returned to the page allocator as soon as it is empty. */
+
+#include "vm/zsmalloc.h"
+#include <debug.h>
+#include <limits.h>
+#include <list.h>
+#include <stdint.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+
+#define ZS_ALIGN 32                     /* Size class granularity. */
+#define ZS_CLASS_CNT (ZS_MAX_SIZE / ZS_ALIGN)  /* Number of classes. */
+#define ZS_MAX_PAGES 4                  /* Most pages in a zspage. */
+#define ZS_NONE UINT_MAX                /* End of a free list. */
+
+/* Objects of one size. */
+struct size_class {
+	size_t size;                        /* Object size. */
+	size_t page_cnt;                    /* Pages per zspage. */
+	unsigned obj_cnt;                   /* Objects per zspage. */
+	struct list partial;                /* Zspages with free objects. */
+};
+
+/* Contiguous pages divided into objects of one class. */
+struct zspage {
+	struct list_elem elem;              /* Element in partial list. */
+	struct size_class *class;           /* Class of the objects. */
+	uint8_t *base;                      /* First page. */
+	unsigned free_idx;                  /* First free object, or ZS_NONE. */
+	unsigned used_cnt;                  /* Objects allocated. */
+};
+
+static struct size_class classes[ZS_CLASS_CNT];
+static size_t page_limit;               /* Most pages to allocate. */
+static size_t page_cnt;                 /* Pages allocated. */
+
+/* Sets up the size classes, allowing at most MAX_PAGES pages to be
+ * allocated. */
+void
+zs_init (size_t max_pages) {
+	size_t i, n;
+
+	page_limit = max_pages;
+	for (i = 0; i < ZS_CLASS_CNT; i++) {
+		struct size_class *c = &classes[i];
+		size_t best_waste = SIZE_MAX;
+
+		c->size = (i + 1) * ZS_ALIGN;
+		for (n = 1; n <= ZS_MAX_PAGES; n++) {
+			/* Compare wasted space as a fraction of the zspage. */
+			size_t waste = (n * PGSIZE % c->size) * ZS_MAX_PAGES / n;
+			if (waste < best_waste) {
+				best_waste = waste;
+				c->page_cnt = n;
+			}
+		}
+		c->obj_cnt = c->page_cnt * PGSIZE / c->size;
+		list_init (&c->partial);
+	}
+}
+
+/* Returns the address of object IDX in ZSPAGE. */
+static void *
+obj_addr (const struct zspage *zspage, unsigned idx) {
+	return zspage->base + idx * zspage->class->size;
+}
+
+/* Allocates a zspage for class C and puts it on C's partial list.
+ * Returns false if the page limit would be exceeded or memory is
+ * short. */
+static bool
+zspage_create (struct size_class *c) {
+	struct zspage *zspage;
+	unsigned i;
+
+	if (page_cnt + c->page_cnt > page_limit)
+		return false;
+	zspage = malloc (sizeof *zspage);
+	if (zspage == NULL)
+		return false;
+	zspage->base = palloc_get_multiple (0, c->page_cnt);
+	if (zspage->base == NULL) {
+		free (zspage);
+		return false;
+	}
+	zspage->class = c;
+	zspage->used_cnt = 0;
+	zspage->free_idx = 0;
+	for (i = 0; i < c->obj_cnt; i++)
+		*(unsigned *) obj_addr (zspage, i) = i + 1 < c->obj_cnt
+			? i + 1 : ZS_NONE;
+	list_push_front (&c->partial, &zspage->elem);
+	page_cnt += c->page_cnt;
+	return true;
+}
+
+/* Allocates an object of SIZE bytes, which must be nonzero and at most
+ * ZS_MAX_SIZE, into *H.  Returns false if the page limit is reached or
+ * memory is short. */
+bool
+zs_malloc (size_t size, struct zs_handle *h) {
+	struct size_class *c;
+	struct zspage *zspage;
+
+	ASSERT (size > 0 && size <= ZS_MAX_SIZE);
+
+	c = &classes[(size - 1) / ZS_ALIGN];
+	if (list_empty (&c->partial) && !zspage_create (c))
+		return false;
+	zspage = list_entry (list_front (&c->partial), struct zspage, elem);
+
+	h->zspage = zspage;
+	h->idx = zspage->free_idx;
+	zspage->free_idx = *(unsigned *) obj_addr (zspage, h->idx);
+	if (++zspage->used_cnt == c->obj_cnt)
+		list_remove (&zspage->elem);
+	return true;
+}
+
+/* Returns the address of the object in H. */
+void *
+zs_map (const struct zs_handle *h) {
+	return obj_addr (h->zspage, h->idx);
+}
+
+/* Frees the object in H. */
+void
+zs_free (struct zs_handle *h) {
+	struct zspage *zspage = h->zspage;
+	struct size_class *c = zspage->class;
+
+	ASSERT (zspage->used_cnt > 0);
+
+	if (zspage->used_cnt-- == c->obj_cnt)
+		list_push_front (&c->partial, &zspage->elem);
+	if (zspage->used_cnt == 0) {
+		list_remove (&zspage->elem);
+		palloc_free_multiple (zspage->base, c->page_cnt);
+		page_cnt -= c->page_cnt;
+		free (zspage);
+	} else {
+		*(unsigned *) obj_addr (zspage, h->idx) = zspage->free_idx;
+		zspage->free_idx = h->idx;
+	}
+	h->zspage = NULL;
+}
+
+/* Returns the number of pages allocated. */
+size_t
+zs_pages (void) {
+	return page_cnt;
+}
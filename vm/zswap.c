@@ -0,0 +1,204 @@
+/* zswap.c: Compressed cache in front of the swap disk.
+ *
+ * A page on its way to a swap slot is compressed first, and if it
+ * shrinks to ZS_MAX_SIZE bytes or less and the pool has room, it is
+ * kept in memory instead of being written.  Reading it back is then a
+ * decompression instead of a disk command.  Pages whose 64-bit words
+ * all hold the same value, mostly pages of zeros, are kept as that one
+ * value.  Pages that do not compress, or that arrive when the pool is
+ * full, go to disk as before.
+ *
+ * As in Linux's zswap, a page keeps the slot it was given, which is
+ * simply never written, so the slot number is the page's key here and
+ * the swap code needs no other changes.  All of these functions are
+ * called with the swap lock held. */
+
+#include "vm/zswap.h"
+#include <debug.h>
+#include <lz.h>
+#include <ohash.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+#include "vm/zsmalloc.h"
+
+/* Most pool pages, set by the -zswap option.  0 turns zswap off. */
+size_t zswap_max_pages = 128;
+
+/* A page stored in the pool. */
+struct zswap_entry {
+	struct ohash_elem hash_elem;     /* Element in entries. */
+	size_t slot;                     /* Swap slot. */
+	size_t len;                      /* Compressed length, or 0 if the page
+	                                    is same-filled. */
+	uint64_t fill;                   /* Value of a same-filled page. */
+	struct zs_handle handle;         /* Compressed data, unless
+	                                    same-filled. */
+};
+
+static struct ohash entries;         /* Stored pages, by slot. */
+
+/* Buffers for compression. */
+static uint8_t compressed[ZS_MAX_SIZE];
+static uint8_t work[LZ_WORK_SIZE];
+
+/* Statistics. */
+static size_t stores;                /* Pages stored, sparing a write. */
+static size_t same_filled;           /* ...of which same-filled. */
+static size_t loads;                 /* Pages read back from the pool. */
+static size_t rejected_size;         /* Pages that did not compress. */
+static size_t rejected_full;         /* Pages that did not fit. */
+static uint64_t bytes_in;            /* Bytes of pages compressed... */
+static uint64_t bytes_out;           /* ...and bytes they took. */
+
+static uint64_t entry_hash (const struct ohash_elem *, void *);
+static bool entry_less (const struct ohash_elem *, const struct ohash_elem *,
+		void *);
+
+/* Sets up the pool. */
+void
+zswap_init (void) {
+	zs_init (zswap_max_pages);
+	if (!ohash_init (&entries, entry_hash, entry_less, NULL))
+		PANIC ("zswap_init: out of memory");
+}
+
+/* Returns the entry for SLOT, or a null pointer. */
+static struct zswap_entry *
+entry_find (size_t slot) {
+	struct zswap_entry key;
+	struct ohash_elem *e;
+
+	key.slot = slot;
+	e = ohash_find (&entries, &key.hash_elem);
+	return e != NULL ? ohash_entry (e, struct zswap_entry, hash_elem) : NULL;
+}
+
+/* Removes E from the pool and frees it. */
+static void
+entry_free (struct zswap_entry *e) {
+	ohash_delete (&entries, &e->hash_elem);
+	if (e->len > 0)
+		zs_free (&e->handle);
+	free (e);
+}
+
+/* If every 64-bit word of the page at KVA is the same, stores it in
+ * *FILL and returns true. */
+static bool
+page_same_filled (const void *kva, uint64_t *fill) {
+	const uint64_t *p = kva;
+	size_t i;
+
+	for (i = 1; i < PGSIZE / sizeof *p; i++)
+		if (p[i] != p[0])
+			return false;
+	*fill = p[0];
+	return true;
+}
+
+/* Tries to keep the page at KVA, on its way to SLOT, in the pool.
+ * Returns true if it was kept, false if it must be written. */
+bool
+zswap_store (size_t slot, const void *kva) {
+	struct zswap_entry *e;
+
+	if (zswap_max_pages == 0)
+		return false;
+	e = malloc (sizeof *e);
+	if (e == NULL)
+		return false;
+	e->slot = slot;
+	e->len = 0;
+
+	if (page_same_filled (kva, &e->fill))
+		same_filled++;
+	else {
+		e->len = lz_compress (kva, PGSIZE, compressed, sizeof compressed,
+				work);
+		if (e->len == 0) {
+			rejected_size++;
+			free (e);
+			return false;
+		}
+		if (!zs_malloc (e->len, &e->handle)) {
+			rejected_full++;
+			free (e);
+			return false;
+		}
+		memcpy (zs_map (&e->handle), compressed, e->len);
+		bytes_in += PGSIZE;
+		bytes_out += e->len;
+	}
+
+	ASSERT (entry_find (slot) == NULL);
+	ohash_insert (&entries, &e->hash_elem);
+	stores++;
+	return true;
+}
+
+/* If the page in SLOT is in the pool, reads it into KVA, drops it from
+ * the pool, and returns true.  Otherwise returns false. */
+bool
+zswap_load (size_t slot, void *kva) {
+	struct zswap_entry *e = entry_find (slot);
+
+	if (e == NULL)
+		return false;
+	if (e->len == 0) {
+		uint64_t *p = kva;
+		size_t i;
+
+		for (i = 0; i < PGSIZE / sizeof *p; i++)
+			p[i] = e->fill;
+	} else if (!lz_decompress (zs_map (&e->handle), e->len, kva, PGSIZE))
+		PANIC ("zswap: slot %zu is corrupt", slot);
+	entry_free (e);
+	loads++;
+	return true;
+}
+
+/* Returns true if the page in SLOT is in the pool. */
+bool
+zswap_contains (size_t slot) {
+	return entry_find (slot) != NULL;
+}
+
+/* Drops the page in SLOT, if any, from the pool. */
+void
+zswap_invalidate (size_t slot) {
+	struct zswap_entry *e = entry_find (slot);
+
+	if (e != NULL)
+		entry_free (e);
+}
+
+/* Prints zswap statistics. */
+void
+zswap_print_stats (void) {
+	size_t ratio = bytes_out > 0 ? bytes_in * 10 / bytes_out : 0;
+
+	printf ("Zswap: %zu disk writes avoided (%zu same-filled pages), "
+			"%zu pages loaded, %zu rejected (%zu incompressible), "
+			"%zu.%zu:1 compression, %zu of %zu pool pages, %zu pages held\n",
+			stores, same_filled, loads,
+			rejected_size + rejected_full, rejected_size,
+			ratio / 10, ratio % 10, zs_pages (), zswap_max_pages,
+			ohash_size (&entries));
+}
+
+/* Returns the hash value of zswap entry E. */
+static uint64_t
+entry_hash (const struct ohash_elem *e, void *aux UNUSED) {
+	return ohash_u64 (ohash_entry (e, struct zswap_entry, hash_elem)->slot);
+}
+
+/* Returns true if zswap entry A's slot precedes B's. */
+static bool
+entry_less (const struct ohash_elem *a, const struct ohash_elem *b,
+		void *aux UNUSED) {
+	return (ohash_entry (a, struct zswap_entry, hash_elem)->slot
+			< ohash_entry (b, struct zswap_entry, hash_elem)->slot);
+}